@@ -0,0 +1,88 @@
+#include "alloc_counter.h"
+#include <atomic>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define NR_SANITIZED_MALLOC 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define NR_SANITIZED_MALLOC 1
+#endif
+
+// 只在 cmake -DNR_ALLOC_COUNTER=ON 的构建中替换 malloc，默认构建不改变内存分配
+#if defined(NR_ALLOC_COUNTER) && defined(__GLIBC__) && !defined(NR_SANITIZED_MALLOC)
+#define NR_COUNT_ALLOCATIONS 1
+#endif
+
+namespace {
+
+// 常量初始化，进程启动早期（静态构造之前）的申请也能安全访问
+std::atomic<bool> counting{false};
+std::atomic<size_t> allocations{0};
+
+inline void count_allocation() {
+    if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+#ifdef NR_COUNT_ALLOCATIONS
+#include <cerrno>
+#include <cstddef>
+
+// 可执行文件中定义的 malloc 等会覆盖 libc 中的同名函数（包括 libstdc++ 内部的调用），
+// 计数后转交 glibc 的实现；free 不需要替换，内存仍由 glibc 的堆管理
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+    count_allocation();
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+void* realloc(void* ptr, size_t size) {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+void* memalign(size_t alignment, size_t size) {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+void* aligned_alloc(size_t alignment, size_t size) {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    count_allocation();
+    void* p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+}
+#endif
+
+bool allocation_counting_supported() {
+#ifdef NR_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void start_allocation_counting() {
+    allocations.store(0, std::memory_order_relaxed);
+    counting.store(true, std::memory_order_release);
+}
+
+void stop_allocation_counting() { counting.store(false, std::memory_order_release); }
+
+size_t allocation_count() { return allocations.load(std::memory_order_relaxed); }
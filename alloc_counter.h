@@ -0,0 +1,19 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+
+// 统计整个进程的堆内存申请次数，用于检查训练/推理的热路径不申请内存（bench alloc）。
+// 计数在 malloc 一层：Eigen 的矩阵与 GEMM 打包缓冲区直接调用 std::malloc，operator new 也经由 malloc，
+// 只替换 operator new 会漏掉 Eigen 的申请。替换 malloc 需要在构建时打开（cmake -DNR_ALLOC_COUNTER=ON），
+// 且仅在 glibc 上可用，sanitizer 构建中也不替换（sanitizer 运行时有自己的 malloc）；
+// 不支持时 allocation_counting_supported() 返回 false。打开后未计数时每次申请只多一次 relaxed 原子读
+
+bool allocation_counting_supported();
+// 开始计数并清零 / 停止计数
+void start_allocation_counting();
+void stop_allocation_counting();
+// 自 start_allocation_counting() 以来（各线程合计）的申请次数
+size_t allocation_count();
+
+#endif
@@ -0,0 +1,138 @@
+#include "base64.h"
+#include "util.h"
+#include <array>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NR_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint8_t kInvalid = 0xFF;
+
+// 字符 -> 6 位取值，非法字符为 kInvalid
+std::array<uint8_t, 256> make_decode_table() {
+    std::array<uint8_t, 256> table;
+    table.fill(kInvalid);
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < 64; ++i) table[static_cast<uint8_t>(alphabet[i])] = static_cast<uint8_t>(i);
+    return table;
+}
+
+const std::array<uint8_t, 256> kDecodeTable = make_decode_table();
+
+// 去掉末尾的填充后的有效字符数，长度不合法时返回 -1
+ptrdiff_t payload_length(std::string_view in) {
+    if (in.size() % 4 != 0) return -1;
+    size_t n = in.size();
+    if (n > 0 && in[n - 1] == '=') --n;
+    if (n > 0 && in[n - 1] == '=') --n;
+    return static_cast<ptrdiff_t>(n);
+}
+
+// 标量解码 src[0, n)（n 为有效字符数，不含填充），每 4 个字符得到 3 个字节
+ptrdiff_t decode_scalar(const char* src, size_t n, uint8_t* dst) {
+    uint8_t* out = dst;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32_t a = kDecodeTable[static_cast<uint8_t>(src[i])];
+        uint32_t b = kDecodeTable[static_cast<uint8_t>(src[i + 1])];
+        uint32_t c = kDecodeTable[static_cast<uint8_t>(src[i + 2])];
+        uint32_t d = kDecodeTable[static_cast<uint8_t>(src[i + 3])];
+        if ((a | b | c | d) & 0xC0) return -1; // 非法字符的取值为 0xFF
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<uint8_t>(v >> 16);
+        out[1] = static_cast<uint8_t>(v >> 8);
+        out[2] = static_cast<uint8_t>(v);
+        out += 3;
+    }
+    // 末尾 2 或 3 个字符（原来以 "==" 或 "=" 结尾）
+    size_t rest = n - i;
+    if (rest == 1) return -1;
+    if (rest >= 2) {
+        uint32_t v = 0;
+        for (size_t k = 0; k < rest; ++k) {
+            uint32_t x = kDecodeTable[static_cast<uint8_t>(src[i + k])];
+            if (x & 0xC0) return -1;
+            v |= x << (18 - 6 * k);
+        }
+        *out++ = static_cast<uint8_t>(v >> 16);
+        if (rest == 3) *out++ = static_cast<uint8_t>(v >> 8);
+    }
+    return out - dst;
+}
+
+#ifdef NR_X86_SIMD
+// AVX2：每次 32 个字符 -> 24 个字节。先用高低半字节查表同时完成合法性检查和字符到 6 位取值的平移，
+// 再用两次乘加把 4 个 6 位值拼成 24 位，最后重排字节（Muła 与 Lemire 的向量化 base64 方法）。
+// 每次写出 32 字节（后 8 字节无效，下一轮覆盖），调用方保证 dst 有足够余量；
+// 返回已处理的字符数，遇到非法字符时停在该块之前交给标量版本报错
+__attribute__((target("avx2"))) size_t decode_avx2(const char* src, size_t n, uint8_t* dst, size_t dst_capacity) {
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    const __m256i merge_6bit = _mm256_set1_epi32(0x01400140);
+    const __m256i merge_12bit = _mm256_set1_epi32(0x00011000);
+    const __m256i pack_bytes = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    size_t i = 0, o = 0;
+    while (i + 32 <= n && o + 32 <= dst_capacity) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        __m256i values = _mm256_add_epi8(in, roll);
+        __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(values, merge_6bit), merge_12bit);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack_bytes), pack_lanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + o), packed);
+        i += 32;
+        o += 24;
+    }
+    return i;
+}
+#endif // NR_X86_SIMD
+
+} // namespace
+
+size_t base64_decoded_size(std::string_view in) {
+    ptrdiff_t n = payload_length(in);
+    if (n < 0 || n % 4 == 1) return 0;
+    return static_cast<size_t>(n) / 4 * 3 + (n % 4 == 0 ? 0 : n % 4 - 1);
+}
+
+ptrdiff_t base64_decode(std::string_view in, uint8_t* dst) {
+    ptrdiff_t n = payload_length(in);
+    if (n < 0) return -1;
+    size_t done = 0;
+#ifdef NR_X86_SIMD
+    if (simd_level() != SimdLevel::Scalar)
+        done = decode_avx2(in.data(), n, dst, base64_decoded_size(in));
+#endif
+    ptrdiff_t tail = decode_scalar(in.data() + done, n - done, dst + done / 4 * 3);
+    return tail < 0 ? -1 : static_cast<ptrdiff_t>(done / 4 * 3) + tail;
+}
+
+bool base64_decode(std::string_view in, std::vector<uint8_t>& out) {
+    out.resize(base64_decoded_size(in));
+    ptrdiff_t len = base64_decode(in, out.data());
+    if (len < 0 || static_cast<size_t>(len) != out.size()) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// 标准 base64（A-Z a-z 0-9 + /，末尾可带 '=' 填充，不允许空白字符）解码。
+// 直接读取 in 指向的内存，不复制输入；按 CPU 支持情况使用 AVX2 或标量实现（受 set_simd_level 控制）
+
+// in 解码后的字节数（已扣除填充），长度不合法时返回 0
+size_t base64_decoded_size(std::string_view in);
+// 解码到 dst（容量至少 base64_decoded_size(in) 字节），返回写出的字节数；含非法字符时返回 -1
+ptrdiff_t base64_decode(std::string_view in, uint8_t* dst);
+// 解码到 out（调整为解码后的长度），失败时返回 false 且 out 为空
+bool base64_decode(std::string_view in, std::vector<uint8_t>& out);
+
+#endif
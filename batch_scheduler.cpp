@@ -0,0 +1,96 @@
+#include "batch_scheduler.h"
+#include "logger.h"
+#include <algorithm>
+#include <exception>
+
+BatchScheduler::BatchScheduler(const ModelStore& models, const BatchOptions& options)
+    : models(models), options(options)
+{
+    this->options.max_batch = std::max(1, options.max_batch);
+    this->options.max_delay_us = std::max(0, options.max_delay_us);
+    inputs.resize(models.current()->num_inputs(), this->options.max_batch);
+    worker = std::thread(&BatchScheduler::worker_loop, this);
+}
+
+BatchScheduler::~BatchScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+std::future<BatchScheduler::Result> BatchScheduler::submit(NeuralNetwork::Vector input) {
+    Request request{std::move(input), std::promise<Result>(), Clock::now()};
+    std::future<Result> result = request.promise.get_future();
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(request));
+        queued = queue.size();
+    }
+    // 队列由空变为非空（开始计时）或凑满一批时才需要唤醒后台线程
+    if (queued == 1 || static_cast<int>(queued) >= options.max_batch) cv.notify_one();
+    return result;
+}
+
+void BatchScheduler::worker_loop() {
+    std::vector<Request> batch;
+    batch.reserve(options.max_batch);
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return; // stopping 且队列已清空
+            // 以最早的请求到达时间为起点，最多等待 max_delay_us 凑批
+            Clock::time_point deadline = queue.front().arrival + std::chrono::microseconds(options.max_delay_us);
+            cv.wait_until(lock, deadline, [this] {
+                return stopping || static_cast<int>(queue.size()) >= options.max_batch;
+            });
+            size_t n = std::min(queue.size(), static_cast<size_t>(options.max_batch));
+            for (size_t i = 0; i < n; ++i) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        run_batch(batch);
+        batch.clear();
+    }
+}
+
+void BatchScheduler::run_batch(std::vector<Request>& batch) {
+    // 整批使用同一份模型快照，期间发布的新模型不影响这一批
+    ModelStore::Snapshot net = models.current();
+    // 维度不符的输入不参与计算，直接返回 label = -1
+    int n = 0;
+    for (Request& request : batch) {
+        if (request.input.size() == inputs.rows()) inputs.col(n++) = request.input;
+    }
+    std::vector<int> labels;
+    bool failed = false;
+    if (n > 0) {
+        Clock::time_point start = Clock::now();
+        // 异常不能离开后台线程（会终止进程），也不能让等待中的请求永远拿不到结果：整批返回 label = -1
+        try {
+            labels = net->predict_batch(inputs.leftCols(n), &probabilities);
+        } catch (const std::exception& e) {
+            LOG_ERROR("批量推理失败（" << n << " 条请求）: " << e.what());
+            failed = true;
+        }
+        if (options.on_batch && !failed)
+            options.on_batch(n, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+
+    int j = 0;
+    for (Request& request : batch) {
+        Result result{-1, {}};
+        if (!failed && request.input.size() == inputs.rows()) {
+            result.label = labels[j];
+            result.probabilities.assign(probabilities.col(j).data(),
+                                        probabilities.col(j).data() + probabilities.rows());
+            ++j;
+        }
+        request.promise.set_value(std::move(result));
+    }
+}
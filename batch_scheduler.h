@@ -0,0 +1,69 @@
+#ifndef BATCH_SCHEDULER_H
+#define BATCH_SCHEDULER_H
+
+#include "neural_net.h"
+#include "model_store.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 微批处理参数
+struct BatchOptions {
+    int max_batch = 32;     // 一批最多合并的请求数，1 表示不合并
+    int max_delay_us = 2000; // 第一条请求最多等待多久（微秒）就必须开始计算
+    // 每算完一批在后台线程调用一次：批大小与前向传播耗时（秒），可用于监控
+    std::function<void(int batch_size, double forward_seconds)> on_batch;
+};
+
+// 位于 Web 请求处理线程与网络之间的微批处理调度器：各线程 submit 单张图像后拿到 future，
+// 后台线程把排队的请求凑成一批做一次 predict_batch，再逐个完成 future。
+// 批满 max_batch 立即计算，否则最早的请求等满 max_delay_us 后也会计算，单个请求的额外延迟有上界。
+// 每批开始时从 ModelStore 取一次当前模型，热更新后的下一批即使用新模型
+class BatchScheduler {
+public:
+    // label 为 -1 表示这条请求没有得到结果（输入维度与模型不符，或这一批推理时出错），probabilities 为空
+    struct Result {
+        int label;
+        std::vector<float> probabilities;
+    };
+
+    BatchScheduler(const ModelStore& models, const BatchOptions& options);
+    ~BatchScheduler(); // 处理完已排队的请求后退出
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    // input 为 input_size 维的网络输入，可从任意线程调用
+    std::future<Result> submit(NeuralNetwork::Vector input);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        NeuralNetwork::Vector input;
+        std::promise<Result> promise;
+        Clock::time_point arrival;
+    };
+
+    void worker_loop();
+    void run_batch(std::vector<Request>& batch);
+
+    const ModelStore& models;
+    BatchOptions options;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Request> queue;
+    bool stopping = false;
+
+    // 仅由后台线程使用：inputs 按最大批分配一次；probabilities 由 predict_batch 按每批的大小重新赋值
+    NeuralNetwork::Matrix inputs, probabilities;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,1194 @@
+#include "benchmark.h"
+#include "mnist_loader.h"
+#include "neural_net.h"
+#include "util.h"
+#include "thread_pool.h"
+#include "batch_scheduler.h"
+#include "model_store.h"
+#include "base64.h"
+#include "logger.h"
+#include "preprocess.h"
+#include "png_decode.h"
+#include "quantized_net.h"
+#include "fixed_net.h"
+#include "sequential.h"
+#include "alloc_counter.h"
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <zlib.h>
+#ifdef NR_USE_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 读取 "--key value" 形式的整数参数，缺省时返回 fallback
+int int_option(int argc, char* argv[], const std::string& key, int fallback) {
+    for (int i = 3; i + 1 < argc; ++i)
+        if (key == argv[i]) return std::atoi(argv[i + 1]);
+    return fallback;
+}
+
+struct Dataset {
+    MnistImages images;
+    std::vector<uint8_t> labels;
+};
+
+bool load_dataset(const std::string& image_path, const std::string& label_path, Dataset& data) {
+    if (!data.images.open(image_path) || !load_mnist_labels(label_path, data.labels)) {
+        std::cerr << "无法加载数据集: " << image_path << std::endl;
+        return false;
+    }
+    // 各项测试的网络输入均为 784 维
+    if (data.images.pixels() != 784) {
+        std::cerr << "数据集的图像不是 28x28: " << image_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+double accuracy(NeuralNetwork& net, const Dataset& test) {
+    std::vector<int> preds = net.predict_batch(test.images);
+    int correct = 0;
+    for (size_t i = 0; i < preds.size(); ++i)
+        if (preds[i] == test.labels[i]) correct++;
+    return 100.0 * correct / test.images.size();
+}
+
+// 串行逐样本 SGD 与 Hogwild 异步 SGD 的 “墙钟时间-测试准确率” 对比
+void bench_hogwild(int argc, char* argv[]) {
+    Dataset train, test;
+    if (!load_dataset("../data/train-images-idx3-ubyte", "../data/train-labels-idx1-ubyte", train) ||
+        !load_dataset("../data/t10k-images-idx3-ubyte", "../data/t10k-labels-idx1-ubyte", test))
+        return;
+    int epochs = int_option(argc, argv, "--epochs", 3);
+    int threads = int_option(argc, argv, "--threads", 4);
+
+    for (int mode = 0; mode < 2; ++mode) {
+        TrainOptions options;
+        options.epochs = 1;
+        options.hogwild = mode == 1;
+        options.num_threads = mode == 1 ? threads : 1;
+        std::cout << (mode == 0 ? "串行 SGD" : "Hogwild SGD") << " (threads=" << options.num_threads << ")" << std::endl;
+
+        NeuralNetwork net(784, 128, 10);
+        double elapsed = 0.0;
+        for (int epoch = 0; epoch < epochs; ++epoch) {
+            auto start = Clock::now();
+            net.train(train.images, train.labels, options);
+            elapsed += seconds_since(start);
+            std::cout << "  累计训练时间 " << std::fixed << std::setprecision(2) << elapsed << " s"
+                      << " | 测试准确率 " << accuracy(net, test) << "%" << std::endl;
+        }
+    }
+}
+
+// 稀疏输入第一层与稠密第一层的训练速度对比（逐样本 SGD 与小批量各一个 epoch）
+void bench_sparse(int argc, char* argv[]) {
+    Dataset train;
+    SparseImages<float> sparse;
+    if (!load_dataset("../data/train-images-idx3-ubyte", "../data/train-labels-idx1-ubyte", train))
+        return;
+    make_sparse_images(train.images, sparse);
+    std::cout << "非零像素比例: " << std::fixed << std::setprecision(2)
+              << 100.0 * sparse.values.size() / (sparse.size() * sparse.pixels) << "%" << std::endl;
+
+    int batch = int_option(argc, argv, "--batch", 64);
+    for (int batch_size : {1, batch}) {
+        TrainOptions options;
+        options.epochs = 1;
+        options.batch_size = batch_size;
+        double dense_time, sparse_time;
+        {
+            NeuralNetwork net(784, 128, 10);
+            auto start = Clock::now();
+            net.train(train.images, train.labels, options);
+            dense_time = seconds_since(start);
+        }
+        {
+            NeuralNetwork net(784, 128, 10);
+            auto start = Clock::now();
+            net.train(sparse, train.labels, options);
+            sparse_time = seconds_since(start);
+        }
+        std::cout << "batch=" << batch_size << " | 稠密 " << dense_time << " s | 稀疏 " << sparse_time
+                  << " s | 加速 " << dense_time / sparse_time << "x" << std::endl;
+    }
+}
+
+// 加载已训练模型的耗时：原先先构造网络（随机初始化 ~10 万个正态分布样本）再 load_parameters，
+// 与 from_file 按文件尺寸直接加载对比，并检查两者推理结果一致
+void bench_startup(int argc, char* argv[]) {
+    int rounds = int_option(argc, argv, "--rounds", 50);
+    std::string path = (std::filesystem::temp_directory_path() / "nr_bench_model.bin").string();
+    if (!NeuralNetwork(784, 128, 10).save_parameters(path)) return;
+
+    double construct_ms = 0, old_ms = 0, factory_ms = 0;
+    bool same = true;
+    NeuralNetwork::Vector input = NeuralNetwork::Vector::Random(784);
+    for (int r = 0; r < rounds; ++r) {
+        auto start = Clock::now();
+        NeuralNetwork old_net(784, 128, 10);
+        construct_ms += seconds_since(start) * 1e3;
+        old_net.load_parameters(path);
+        old_ms += seconds_since(start) * 1e3;
+
+        start = Clock::now();
+        std::unique_ptr<NeuralNetwork> net = NeuralNetwork::from_file(path);
+        factory_ms += seconds_since(start) * 1e3;
+        if (!net) return;
+        same = same && net->forward(input) == old_net.forward(input);
+    }
+    std::remove(path.c_str());
+    std::cout << std::fixed << std::setprecision(3) << "加载模型 " << rounds << " 次的平均耗时\n"
+              << "构造 + load_parameters: " << old_ms / rounds << " ms（其中随机初始化 " << construct_ms / rounds << " ms）\n"
+              << "from_file: " << factory_ms / rounds << " ms | 加速 " << std::setprecision(1) << old_ms / factory_ms
+              << "x | 推理结果一致: " << (same ? "是" : "否") << std::endl;
+}
+
+// 逐图像展开为 float 向量与 mmap 零拷贝映射的加载时间和内存占用对比，并检查两者像素一致
+void bench_loader(int, char*[]) {
+    const std::string path = "../data/train-images-idx3-ubyte";
+    std::vector<NeuralNetwork::Vector> vectors;
+    auto start = Clock::now();
+    if (!load_mnist_images(path, vectors)) return;
+    double vector_time = seconds_since(start);
+
+    start = Clock::now();
+    MnistImages images;
+    if (!images.open(path)) return;
+    // 遍历一遍所有像素，把缺页的开销也计入
+    long long checksum = images.matrix().cast<long long>().sum();
+    double mmap_time = seconds_since(start);
+
+    bool same = vectors.size() == images.size();
+    for (size_t i = 0; same && i < vectors.size(); ++i)
+        same = vectors[i] == images.image(i).cast<float>() / 255.0f;
+    std::cout << std::fixed << std::setprecision(3)
+              << "逐图像 float 向量: " << vector_time << " s, "
+              << vectors.size() * images.pixels() * sizeof(float) / (1 << 20) << " MiB\n"
+              << "mmap uint8 矩阵:   " << mmap_time << " s, "
+              << images.size() * images.pixels() / (1 << 20) << " MiB (像素和 " << checksum << ")\n"
+              << "像素一致: " << (same ? "是" : "否") << std::endl;
+}
+
+// 逐张 predict（矩阵乘向量）与 predict_batch（矩阵乘矩阵）在测试集上的吞吐量，并检查预测一致
+void bench_inference(int, char*[]) {
+    Dataset test;
+    if (!load_dataset("../data/t10k-images-idx3-ubyte", "../data/t10k-labels-idx1-ubyte", test))
+        return;
+    NeuralNetwork net(784, 128, 10);
+    size_t count = test.images.size();
+
+    auto start = Clock::now();
+    std::vector<int> single(count);
+    NeuralNetwork::Vector image;
+    for (size_t i = 0; i < count; ++i) {
+        image = test.images.image(i).cast<float>() / 255.0f;
+        single[i] = net.predict(image);
+    }
+    double single_time = seconds_since(start);
+
+    start = Clock::now();
+    std::vector<int> batch = net.predict_batch(test.images.matrix().data(), count);
+    double batch_time = seconds_since(start);
+
+    std::cout << std::fixed << std::setprecision(0)
+              << "逐张 predict:   " << count / single_time << " 张/s\n"
+              << "predict_batch: " << count / batch_time << " 张/s" << std::setprecision(2)
+              << " | 加速 " << single_time / batch_time << "x"
+              << " | 预测一致: " << (single == batch ? "是" : "否") << std::endl;
+}
+
+// 并发推理压力测试：多个线程同时对同一个 const 网络交替调用 predict 与不同批大小的
+// predict_batch，结果必须与单线程一致。配合 -DNR_SANITIZER=thread 构建可检查数据竞争
+void bench_concurrency(int argc, char* argv[]) {
+    Dataset test;
+    if (!load_dataset("../data/t10k-images-idx3-ubyte", "../data/t10k-labels-idx1-ubyte", test))
+        return;
+    int threads = int_option(argc, argv, "--threads", 8);
+    int rounds = int_option(argc, argv, "--rounds", 20);
+    const NeuralNetwork net(784, 128, 10);
+    const uint8_t* pixels = test.images.matrix().data();
+    const int count = static_cast<int>(test.images.size());
+    const int pixel_count = test.images.pixels();
+    std::vector<int> expected = net.predict_batch(pixels, count);
+
+    ThreadPool pool(threads);
+    std::vector<long long> mismatches(threads, 0), predictions(threads, 0);
+    auto start = Clock::now();
+    pool.run([&](int t) {
+        NeuralNetwork::Vector image;
+        // 各线程从不同位置出发，批大小各不相同，让各线程的缓冲区尺寸交错变化
+        for (int round = 0; round < rounds; ++round) {
+            int begin = (t * 997 + round * 131) % count;
+            int batch = 1 + (t * 7 + round * 13) % 64;
+            int n = std::min(batch, count - begin);
+            std::vector<int> labels = net.predict_batch(pixels + size_t(begin) * pixel_count, n);
+            for (int j = 0; j < n; ++j)
+                if (labels[j] != expected[begin + j]) mismatches[t]++;
+            predictions[t] += n;
+            for (int j = 0; j < n; ++j) {
+                image = test.images.image(begin + j).cast<float>() / 255.0f;
+                if (net.predict(image) != expected[begin + j]) mismatches[t]++;
+            }
+            predictions[t] += n;
+        }
+    });
+    double elapsed = seconds_since(start);
+    long long total_mismatches = 0, total_predictions = 0;
+    for (int t = 0; t < threads; ++t) {
+        total_mismatches += mismatches[t];
+        total_predictions += predictions[t];
+    }
+    std::cout << "threads=" << threads << " | 推理 " << total_predictions << " 次 | "
+              << std::fixed << std::setprecision(0) << total_predictions / elapsed << " 次/s"
+              << " | 与单线程不一致 " << total_mismatches << " 次 | "
+              << (total_mismatches == 0 ? "通过" : "失败") << std::endl;
+
+    // 上面各线程的缓冲区都已增长到最大批，之后逐张 predict 应完全不申请堆内存
+    // （predict_batch / forward 返回新的 std::vector / 矩阵，结果本身要申请内存，不计在内）
+    if (!allocation_counting_supported()) {
+        std::cout << "当前构建不支持统计内存申请（需要用 cmake -DNR_ALLOC_COUNTER=ON 构建，且为 glibc、未启用 ASan/TSan），跳过逐张推理的内存申请检查" << std::endl;
+        return;
+    }
+    std::vector<NeuralNetwork::Vector> images(threads, NeuralNetwork::Vector(pixel_count));
+    std::vector<long long> wrong(threads, 0);
+    start_allocation_counting();
+    pool.run([&](int t) {
+        for (int r = 0; r < 500; ++r) {
+            int i = (t * 997 + r * 31) % count;
+            images[t] = test.images.image(i).cast<float>() / 255.0f;
+            if (net.predict(images[t]) != expected[i]) wrong[t]++;
+        }
+    });
+    stop_allocation_counting();
+    long long wrong_total = 0;
+    for (long long w : wrong) wrong_total += w;
+    std::cout << "逐张 predict " << 500LL * threads << " 次（" << threads << " 线程并发）| 堆内存申请 "
+              << allocation_count() << " 次 | 与单线程不一致 " << wrong_total << " 次" << std::endl;
+}
+
+// 模型热更新：clients 个线程经调度器持续提交请求，同时另一个线程交替把模型 A、B 写入参数文件并重新加载。
+// 每个结果的概率必须与 A 或 B 之一相同（不会出现两份参数混用的批），并对比有无重载时的延迟
+void bench_reload(int argc, char* argv[]) {
+    int clients = int_option(argc, argv, "--clients", 16);
+    int requests = int_option(argc, argv, "--requests", 2000);
+    int reloads = int_option(argc, argv, "--reloads", 50);
+    const int inputs = 64;
+    std::string path = (std::filesystem::temp_directory_path() / "nr_bench_reload.bin").string();
+    NeuralNetwork model_a(784, 128, 10), model_b(784, 128, 10);
+    NeuralNetwork::Matrix images = (NeuralNetwork::Matrix::Random(784, inputs).array() + 1.0f) * 0.5f;
+    NeuralNetwork::Matrix probs_a, probs_b;
+    model_a.predict_batch(images, &probs_a);
+    model_b.predict_batch(images, &probs_b);
+    if (!model_a.save_parameters(path)) return;
+
+    std::unique_ptr<NeuralNetwork> initial = NeuralNetwork::from_file(path);
+    if (!initial) return;
+    ModelStore models(std::move(initial));
+    ModelReloader reloader(models, path, std::chrono::milliseconds(0));
+    BatchOptions options;
+    options.max_delay_us = 200;
+    BatchScheduler scheduler(models, options);
+    ThreadPool pool(clients);
+    LogLevel original_level = log_level();
+    set_log_level(LogLevel::Warn); // 不输出每次发布的日志
+
+    for (bool reloading : {false, true}) {
+        std::vector<std::vector<double>> latencies(clients);
+        std::vector<int> mismatches(clients, 0), from_b(clients, 0);
+        std::atomic<bool> done{false};
+        int published = 0;
+        std::thread writer;
+        if (reloading) {
+            writer = std::thread([&] {
+                for (int r = 0; r < reloads && !done.load(); ++r) {
+                    const NeuralNetwork& next = r % 2 == 0 ? model_b : model_a;
+                    if (next.save_parameters(path) && reloader.reload()) published++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            });
+        }
+        pool.run([&](int t) {
+            for (int r = 0; r < requests; ++r) {
+                int i = (t * 31 + r) % inputs;
+                auto sent = Clock::now();
+                BatchScheduler::Result result = scheduler.submit(images.col(i)).get();
+                latencies[t].push_back(seconds_since(sent) * 1e6);
+                // 不同批大小的矩阵乘法舍入略有差异，按容差比较；A、B 的输出相差远大于容差
+                auto same = [&](const NeuralNetwork::Matrix& probs) {
+                    Eigen::Map<const NeuralNetwork::Vector> got(result.probabilities.data(), probs.rows());
+                    return result.probabilities.size() == size_t(probs.rows()) &&
+                           (got - probs.col(i)).cwiseAbs().maxCoeff() < 1e-5f;
+                };
+                if (same(probs_b)) from_b[t]++;
+                else if (!same(probs_a)) mismatches[t]++;
+            }
+        });
+        done = true;
+        if (writer.joinable()) writer.join();
+
+        std::vector<double> all;
+        int wrong = 0, served_b = 0;
+        for (int t = 0; t < clients; ++t) {
+            all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+            wrong += mismatches[t];
+            served_b += from_b[t];
+        }
+        std::sort(all.begin(), all.end());
+        auto percentile = [&](double p) { return all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+        std::cout << (reloading ? "持续重载" : "不重载") << " | 发布模型 " << published << " 次 | 请求 " << all.size()
+                  << "（模型 B 处理 " << served_b << "）| 结果与 A、B 都不符 " << wrong << " | p50 " << std::fixed
+                  << std::setprecision(0) << percentile(0.50) << " us | p99 " << percentile(0.99) << " us" << std::endl;
+    }
+
+    // 损坏的参数文件：手动重载与监视线程都应判为失败，当前模型保持不变
+    std::vector<std::string> malformed;
+    {
+        const int32_t huge[4] = {0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff}; // 旧格式，维度远超文件长度
+        malformed.emplace_back(reinterpret_cast<const char*>(huge), sizeof(huge));
+        std::ifstream in(path, std::ios::binary);
+        std::string valid((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        malformed.push_back(valid.substr(0, valid.size() / 2)); // 截断
+        malformed.push_back(valid);
+        malformed.back()[valid.size() - 1] ^= 0x55; // CRC 不符
+        malformed.emplace_back(4096, '\x7f');
+    }
+    auto replace_file = [&](const std::string& bytes) {
+        std::string tmp = path + ".tmp";
+        std::ofstream(tmp, std::ios::binary).write(bytes.data(), bytes.size());
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    };
+    set_log_level(LogLevel::Off);
+    ModelStore::Snapshot served = models.current();
+    uint64_t generation = models.generation();
+    std::atomic<int> failures{0};
+    int rejected = 0, watched = 0;
+    {
+        ModelReloader watcher(models, path, std::chrono::milliseconds(20), [&](bool ok) { failures += !ok; });
+        for (const std::string& bytes : malformed) {
+            int before = failures.load();
+            if (!replace_file(bytes)) break;
+            auto start = Clock::now();
+            while (failures.load() == before && seconds_since(start) < 2.0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            watched += failures.load() > before;
+            rejected += !reloader.reload();
+        }
+    }
+    bool kept = models.current() == served && models.generation() == generation;
+    std::cout << "损坏的参数文件 " << malformed.size() << " 种 | 监视线程判为失败 " << watched << " | 手动重载失败 "
+              << rejected << " | 当前模型保持不变: " << (kept ? "是" : "否") << std::endl;
+    set_log_level(original_level);
+    std::remove(path.c_str());
+}
+
+// 微批处理调度器：clients 个线程各自连续提交单张图像请求（模拟并发的 /predict），
+// 对比不合并（max_batch=1）与合并成批时的吞吐量和延迟分位数
+void bench_batching(int argc, char* argv[]) {
+    Dataset test;
+    if (!load_dataset("../data/t10k-images-idx3-ubyte", "../data/t10k-labels-idx1-ubyte", test))
+        return;
+    int clients = int_option(argc, argv, "--clients", 32);
+    int requests = int_option(argc, argv, "--requests", 500);
+    int max_batch = int_option(argc, argv, "--max-batch", 32);
+    int max_delay_us = int_option(argc, argv, "--max-delay-us", 2000);
+    ModelStore models(std::make_shared<const NeuralNetwork>(784, 128, 10));
+    std::vector<int> expected = models.current()->predict_batch(test.images);
+
+    ThreadPool pool(clients);
+    for (int batch : {1, max_batch}) {
+        BatchOptions options;
+        options.max_batch = batch;
+        options.max_delay_us = max_delay_us;
+        BatchScheduler scheduler(models, options);
+        std::vector<std::vector<double>> latencies(clients);
+        std::vector<int> mismatches(clients, 0);
+        auto start = Clock::now();
+        pool.run([&](int t) {
+            latencies[t].reserve(requests);
+            for (int r = 0; r < requests; ++r) {
+                size_t i = (size_t(t) * requests + r) % test.images.size();
+                NeuralNetwork::Vector image = test.images.image(i).cast<float>() / 255.0f;
+                auto sent = Clock::now();
+                int label = scheduler.submit(std::move(image)).get().label;
+                latencies[t].push_back(seconds_since(sent) * 1e6);
+                if (label != expected[i]) mismatches[t]++;
+            }
+        });
+        double elapsed = seconds_since(start);
+        std::vector<double> all;
+        int wrong = 0;
+        for (int t = 0; t < clients; ++t) {
+            all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+            wrong += mismatches[t];
+        }
+        std::sort(all.begin(), all.end());
+        auto percentile = [&](double p) { return all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+        std::cout << "max_batch=" << batch << " | " << std::fixed << std::setprecision(0)
+                  << all.size() / elapsed << " 请求/s | p50 " << percentile(0.50)
+                  << " us | p99 " << percentile(0.99) << " us | 与直接推理不一致 " << wrong << std::endl;
+    }
+}
+
+// 原先 /predict 使用的 OpenSSL BIO 解码（含去掉 data URL 前缀时的 substr 复制），作为对照
+std::string openssl_base64_decode(const std::string& data_url) {
+    std::string input = data_url.substr(data_url.find(',') + 1);
+    std::string result(input.length() * 3 / 4, '\0');
+    BIO* bio = BIO_new_mem_buf(input.data(), -1);
+    BIO* b64 = BIO_new(BIO_f_base64());
+    bio = BIO_push(b64, bio);
+    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
+    int len = BIO_read(bio, &result[0], input.length());
+    BIO_free_all(bio);
+    result.resize(len > 0 ? len : 0);
+    return result;
+}
+
+std::string base64_encode(const std::vector<uint8_t>& data) {
+    const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t v = uint32_t(data[i]) << 16;
+        if (i + 1 < data.size()) v |= uint32_t(data[i + 1]) << 8;
+        if (i + 2 < data.size()) v |= data[i + 2];
+        out += alphabet[(v >> 18) & 63];
+        out += alphabet[(v >> 12) & 63];
+        out += i + 1 < data.size() ? alphabet[(v >> 6) & 63] : '=';
+        out += i + 2 < data.size() ? alphabet[v & 63] : '=';
+    }
+    return out;
+}
+
+// base64 解码：先在各指令集下对随机数据（各种长度及非法输入）检查正确性，
+// 再以 data URL 形式的 PNG 大小数据对比 OpenSSL BIO 与自带解码器的吞吐量
+void bench_base64(int argc, char* argv[]) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    auto random_bytes = [&](size_t n) {
+        std::vector<uint8_t> data(n);
+        for (auto& b : data) b = static_cast<uint8_t>(byte(gen));
+        return data;
+    };
+
+    // base64 只有标量与 AVX2 两个实现（AVX-512 级别也使用 AVX2 实现），只测这两级
+    std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+    if (detected_simd_level() != SimdLevel::Scalar) levels.push_back(SimdLevel::AVX2);
+    SimdLevel original_level = simd_level();
+    bool ok = true;
+    std::vector<uint8_t> decoded;
+    for (SimdLevel level : levels) {
+        set_simd_level(level);
+        for (size_t n = 0; n < 300; ++n) {
+            std::vector<uint8_t> data = random_bytes(n);
+            std::string text = base64_encode(data);
+            ok = ok && base64_decode(text, decoded) && decoded == data;
+            // 任意位置换成非法字符都必须报错
+            if (!text.empty()) {
+                std::string bad = text;
+                bad[n * 7 % bad.size()] = '*';
+                ok = ok && !base64_decode(bad, decoded);
+            }
+        }
+    }
+    std::cout << "正确性检查: " << (ok ? "通过" : "失败") << std::endl;
+
+    size_t size = static_cast<size_t>(int_option(argc, argv, "--bytes", 12000));
+    std::vector<uint8_t> png = random_bytes(size);
+    std::string data_url = "data:image/png;base64," + base64_encode(png);
+    const int repeats = 2000;
+
+    auto start = Clock::now();
+    size_t checksum = 0;
+    for (int r = 0; r < repeats; ++r)
+        checksum += openssl_base64_decode(data_url).size();
+    double openssl_time = seconds_since(start);
+    std::cout << std::fixed << std::setprecision(0)
+              << "OpenSSL BIO: " << repeats * data_url.size() / openssl_time / (1 << 20) << " MiB/s"
+              << (checksum == repeats * size ? "" : " (结果不一致)") << std::endl;
+
+    for (SimdLevel level : levels) {
+        set_simd_level(level);
+        start = Clock::now();
+        checksum = 0;
+        for (int r = 0; r < repeats; ++r) {
+            std::string_view text(data_url);
+            text.remove_prefix(text.find(',') + 1);
+            base64_decode(text, decoded);
+            checksum += decoded.size();
+        }
+        double elapsed = seconds_since(start);
+        std::cout << simd_level_name(level) << ": "
+                  << repeats * data_url.size() / elapsed / (1 << 20) << " MiB/s | 相对 OpenSSL "
+                  << std::setprecision(1) << openssl_time / elapsed << "x" << std::setprecision(0)
+                  << (checksum == repeats * size && decoded == png ? "" : " (结果不一致)") << std::endl;
+    }
+    set_simd_level(original_level);
+}
+
+// 多线程同时写日志时调用方的耗时：直接写 std::cout 与异步日志（全部记录 / 采样）对比。
+// 日志内容写到 stdout，结果写到 stderr，建议运行时把 stdout 重定向到 /dev/null
+void bench_logging(int argc, char* argv[]) {
+    int threads = int_option(argc, argv, "--threads", 8);
+    int messages = int_option(argc, argv, "--messages", 20000);
+    int sample = int_option(argc, argv, "--sample", 100);
+    ThreadPool pool(threads);
+    LogLevel original_level = log_level();
+    set_log_level(LogLevel::Debug);
+
+    for (int mode = 0; mode < 3; ++mode) {
+        set_log_sample_rate(mode == 2 ? sample : 1);
+        size_t dropped_before = log_dropped_count();
+        auto start = Clock::now();
+        pool.run([&](int t) {
+            for (int i = 0; i < messages; ++i) {
+                if (mode == 0)
+                    std::cout << "线程 " << t << " 请求 " << i << " 均值=" << 0.125 * i << std::endl;
+                else
+                    LOG_DEBUG("线程 " << t << " 请求 " << i << " 均值=" << 0.125 * i);
+            }
+        });
+        double produce = seconds_since(start);
+        flush_log();
+        double total = seconds_since(start);
+        const char* names[] = {"std::cout", "异步日志", "异步日志（采样）"};
+        std::cerr << names[mode] << std::fixed << std::setprecision(0)
+                  << " | 调用方 " << produce * 1e9 / (double(threads) * messages) << " ns/条"
+                  << " | 全部写出 " << std::setprecision(3) << total << " s"
+                  << " | 丢弃 " << log_dropped_count() - dropped_before << " 条" << std::endl;
+    }
+    set_log_sample_rate(1);
+    set_log_level(original_level);
+}
+
+// 模拟网页画布：280x280 白底，用 15 像素粗的黑色折线写一个“数字”；
+// 部分图像加一笔分离的短笔画（多笔画），部分只点一个小点（裁剪后小于 28 像素，需要放大）
+std::vector<uint8_t> make_canvas(std::mt19937& gen, int side) {
+    std::vector<uint8_t> canvas(size_t(side) * side, 255);
+    std::uniform_real_distribution<double> pos(side * 0.2, side * 0.8), unit(0.0, 1.0);
+    auto stamp = [&](double cx, double cy, double r) {
+        for (int y = std::max(0, int(cy - r)); y <= std::min(side - 1, int(cy + r)); ++y)
+            for (int x = std::max(0, int(cx - r)); x <= std::min(side - 1, int(cx + r)); ++x)
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r) canvas[size_t(y) * side + x] = 0;
+    };
+    auto stroke = [&](int points) {
+        double x = pos(gen), y = pos(gen);
+        for (int p = 1; p < points; ++p) {
+            double nx = pos(gen), ny = pos(gen);
+            for (double t = 0; t <= 1.0; t += 0.01) stamp(x + (nx - x) * t, y + (ny - y) * t, 7.5);
+            x = nx;
+            y = ny;
+        }
+    };
+    double kind = unit(gen);
+    if (kind < 0.05) {
+        stamp(pos(gen), pos(gen), 3);
+    } else {
+        stroke(3 + int(unit(gen) * 4));
+        if (kind > 0.8) stroke(2);
+    }
+    return canvas;
+}
+
+// 快速预处理与原 OpenCV 实现的对照：结果是否一致、像素差异与单张耗时
+void bench_preprocess(int argc, char* argv[]) {
+    const int side = 280;
+    int count = int_option(argc, argv, "--images", 500);
+    std::mt19937 gen(7);
+    std::vector<std::vector<uint8_t>> canvases;
+    for (int i = 0; i < count; ++i) canvases.push_back(make_canvas(gen, side));
+
+    std::vector<float> fast(size_t(count) * kDigitPixels), reference(size_t(count) * kDigitPixels);
+    std::vector<PreprocessStatus> fast_status(count), reference_status(count);
+    std::vector<PreprocessStats> fast_stats(count), reference_stats(count);
+    using Preprocess = PreprocessStatus (*)(const GrayImage&, float*, PreprocessStats*);
+    auto run = [&](Preprocess preprocess, std::vector<float>& out, std::vector<PreprocessStatus>& status,
+                   std::vector<PreprocessStats>& stats) {
+        auto start = Clock::now();
+        for (int i = 0; i < count; ++i) {
+            GrayImage image{canvases[i].data(), side, side, size_t(side)};
+            float* dst = out.data() + size_t(i) * kDigitPixels;
+            status[i] = preprocess(image, dst, &stats[i]);
+        }
+        return seconds_since(start) * 1e6 / count;
+    };
+    double fast_us = run(preprocess_digit, fast, fast_status, fast_stats);
+#ifndef NR_USE_OPENCV
+    std::cout << "图像 " << count << " 张 | 快速实现: " << std::fixed << std::setprecision(1) << fast_us
+              << " us/张（未启用 OpenCV，不做对照）" << std::endl;
+#else
+    double reference_us = run(preprocess_digit_opencv, reference, reference_status, reference_stats);
+
+    int status_mismatch = 0, same_box = 0, exact = 0, compared = 0;
+    double max_diff = 0, max_diff_same_box = 0;
+    for (int i = 0; i < count; ++i) {
+        if (fast_status[i] != reference_status[i]) {
+            status_mismatch++;
+            continue;
+        }
+        if (fast_status[i] != PreprocessStatus::Ok) continue;
+        compared++;
+        bool box = fast_stats[i].box_x == reference_stats[i].box_x && fast_stats[i].box_y == reference_stats[i].box_y &&
+                   fast_stats[i].box_width == reference_stats[i].box_width &&
+                   fast_stats[i].box_height == reference_stats[i].box_height;
+        double diff = 0;
+        for (int k = 0; k < kDigitPixels; ++k)
+            diff = std::max<double>(diff, std::abs(fast[size_t(i) * kDigitPixels + k] - reference[size_t(i) * kDigitPixels + k]));
+        max_diff = std::max(max_diff, diff);
+        if (box) {
+            same_box++;
+            max_diff_same_box = std::max(max_diff_same_box, diff);
+            if (diff < 1e-6) exact++;
+        }
+    }
+    std::cout << "图像 " << count << " 张 | 结果状态不一致 " << status_mismatch
+              << " | 边界框相同 " << same_box << "/" << compared << "（其余为多笔画，快速实现取全部笔画的边界框）\n"
+              << "边界框相同时: 完全一致 " << exact << " 张，最大像素差 " << std::setprecision(4) << max_diff_same_box
+              << "（1/255 = 0.0039）| 全部最大像素差 " << max_diff << "\n"
+              << std::fixed << std::setprecision(1)
+              << "OpenCV: " << reference_us << " us/张 | 快速实现: " << fast_us << " us/张 | 加速 "
+              << reference_us / fast_us << "x" << std::endl;
+#endif
+}
+
+// 把灰度画布编码为与浏览器 canvas.toDataURL 相同布局的 8 位 RGBA PNG，逐行轮换 5 种滤波方式
+std::vector<uint8_t> encode_canvas_png(const std::vector<uint8_t>& canvas, int side) {
+    const size_t bpp = 4, row_bytes = size_t(side) * bpp;
+    std::vector<uint8_t> rgba(row_bytes * side), filtered;
+    for (size_t i = 0; i < canvas.size(); ++i) {
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = canvas[i];
+        rgba[4 * i + 3] = 255;
+    }
+    std::vector<uint8_t> zero(row_bytes, 0);
+    for (int y = 0; y < side; ++y) {
+        const uint8_t* row = rgba.data() + y * row_bytes;
+        const uint8_t* prev = y > 0 ? row - row_bytes : zero.data();
+        int filter = y % 5;
+        filtered.push_back(static_cast<uint8_t>(filter));
+        for (size_t i = 0; i < row_bytes; ++i) {
+            int a = i >= bpp ? row[i - bpp] : 0, b = prev[i], c = i >= bpp ? prev[i - bpp] : 0;
+            int predictor = 0;
+            if (filter == 1) predictor = a;
+            else if (filter == 2) predictor = b;
+            else if (filter == 3) predictor = (a + b) >> 1;
+            else if (filter == 4) {
+                int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+            }
+            filtered.push_back(static_cast<uint8_t>(row[i] - predictor));
+        }
+    }
+    uLongf compressed_size = compressBound(filtered.size());
+    std::vector<uint8_t> compressed(compressed_size);
+    compress2(compressed.data(), &compressed_size, filtered.data(), filtered.size(), 6);
+    compressed.resize(compressed_size);
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    auto put32 = [&](uint32_t v) {
+        for (int shift = 24; shift >= 0; shift -= 8) png.push_back(static_cast<uint8_t>(v >> shift));
+    };
+    auto chunk = [&](const char* type, const std::vector<uint8_t>& data) {
+        put32(static_cast<uint32_t>(data.size()));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        put32(static_cast<uint32_t>(crc32(0L, png.data() + start, static_cast<uInt>(png.size() - start))));
+    };
+    std::vector<uint8_t> header = {0, 0, 0, 0, 0, 0, 0, 0, 8, 6, 0, 0, 0};
+    for (int i = 0; i < 4; ++i) header[i] = header[4 + i] = static_cast<uint8_t>(side >> (24 - 8 * i));
+    chunk("IHDR", header);
+    chunk("IDAT", compressed);
+    chunk("IEND", {});
+    return png;
+}
+
+// 自带 PNG 解码器的正确性（解码结果应与原画布逐像素相同）与单张耗时，启用 OpenCV 时与 cv::imdecode 对比
+void bench_png(int argc, char* argv[]) {
+    const int side = 280;
+    int count = int_option(argc, argv, "--images", 200);
+    std::mt19937 gen(7);
+    std::vector<std::vector<uint8_t>> canvases, pngs;
+    size_t total_bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        canvases.push_back(make_canvas(gen, side));
+        pngs.push_back(encode_canvas_png(canvases.back(), side));
+        total_bytes += pngs.back().size();
+    }
+
+    int mismatched = 0;
+    PngImage image;
+    auto start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        bool ok = decode_png_gray(pngs[i].data(), pngs[i].size(), image);
+        if (!ok || image.rows != side || image.cols != side || image.pixels != canvases[i]) mismatched++;
+    }
+    double builtin_us = seconds_since(start) * 1e6 / count;
+    std::cout << "PNG " << count << " 张（RGBA " << side << "x" << side << "，平均 " << total_bytes / count
+              << " 字节）| 自带解码器: " << std::fixed << std::setprecision(1) << builtin_us << " us/张 | 结果与原图不一致 "
+              << mismatched << " 张" << std::endl;
+    // 尺寸上限：1024x1024 的 RGBA 画布可以解码，1025x1025 被拒绝
+    for (int limit_side : {1024, 1025}) {
+        std::vector<uint8_t> large = make_canvas(gen, limit_side);
+        std::vector<uint8_t> png = encode_canvas_png(large, limit_side);
+        bool ok = decode_png_gray(png.data(), png.size(), image) && image.pixels == large;
+        std::cout << "RGBA " << limit_side << "x" << limit_side << ": " << (ok ? "已解码" : "拒绝") << std::endl;
+    }
+#ifdef NR_USE_OPENCV
+    int opencv_mismatched = 0;
+    start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        cv::Mat img = cv::imdecode(pngs[i], cv::IMREAD_GRAYSCALE);
+        if (img.rows != side || img.cols != side || !std::equal(canvases[i].begin(), canvases[i].end(), img.data))
+            opencv_mismatched++;
+    }
+    double opencv_us = seconds_since(start) * 1e6 / count;
+    std::cout << "cv::imdecode: " << opencv_us << " us/张 | 结果与原图不一致 " << opencv_mismatched << " 张" << std::endl;
+#endif
+}
+
+// 各指令集 × 各 exp 模式下 float 激活函数相对 double 参考值的最大误差与吞吐量
+void bench_activations(int argc, char* argv[]) {
+    const int rows = 10, cols = int_option(argc, argv, "--cols", 6554);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(-20.0, 20.0);
+    Eigen::MatrixXd input(rows, cols);
+    for (int i = 0; i < input.size(); ++i) input.data()[i] = dist(gen);
+    Eigen::MatrixXd ref_sigmoid = 1.0 / (1.0 + (-input.array()).exp());
+    Eigen::MatrixXd ref_softmax(rows, cols);
+    for (int j = 0; j < cols; ++j) {
+        Eigen::ArrayXd e = (input.col(j).array() - input.col(j).maxCoeff()).exp();
+        ref_softmax.col(j) = e / e.sum();
+    }
+    Eigen::MatrixXd ref_backward = ref_sigmoid.array() * (1.0 - ref_sigmoid.array());
+
+    SimdLevel original_level = simd_level();
+    ActivationMode original_mode = activation_mode();
+    for (int level = 0; level <= static_cast<int>(detected_simd_level()); ++level) {
+        set_simd_level(static_cast<SimdLevel>(level));
+        for (ActivationMode mode : {ActivationMode::Exact, ActivationMode::Fast}) {
+            set_activation_mode(mode);
+            // 容差：精确模式应接近 float 精度，快速模式为多项式近似误差
+            double tolerance = mode == ActivationMode::Exact ? 1e-6 : 5e-4;
+
+            Eigen::MatrixXf s = input.cast<float>();
+            sigmoid_inplace<float>(s);
+            double sigmoid_error = (s.cast<double>() - ref_sigmoid).cwiseAbs().maxCoeff();
+            Eigen::MatrixXf d = Eigen::MatrixXf::Ones(rows, cols);
+            multiply_sigmoid_derivative<float>(d, s);
+            double backward_error = (d.cast<double>() - ref_backward).cwiseAbs().maxCoeff();
+            Eigen::MatrixXf m = input.cast<float>();
+            softmax_columns_inplace<float>(m);
+            double softmax_error = (m.cast<double>() - ref_softmax).cwiseAbs().maxCoeff();
+
+            // 尾部与极端输入：长度 1~33 的单列（覆盖 AVX2/AVX-512 向量宽度的整数倍与各种余数），
+            // 取值含 exp 会上溢/下溢的 ±88、±1000，结果必须是有限值且在同样的容差内
+            const double extremes[] = {-1000.0, 3.5, -88.5, 0.0, 88.5, -1e-3, 100.0, -20.0, 1000.0, 1.0, -100.0};
+            double edge_error = 0.0;
+            bool finite = true;
+            for (int n = 1; n <= 33; ++n) {
+                Eigen::VectorXd z(n);
+                for (int i = 0; i < n; ++i) z(i) = extremes[(i + n) % (sizeof(extremes) / sizeof(extremes[0]))];
+                Eigen::MatrixXf edge_sigmoid = z.cast<float>(), edge_softmax = z.cast<float>();
+                sigmoid_inplace<float>(edge_sigmoid);
+                softmax_columns_inplace<float>(edge_softmax);
+                Eigen::ArrayXd e = (z.array() - z.maxCoeff()).exp();
+                Eigen::VectorXd expected_sigmoid = 1.0 / (1.0 + (-z.array()).exp());
+                Eigen::VectorXd expected_softmax = e / e.sum();
+                finite = finite && edge_sigmoid.allFinite() && edge_softmax.allFinite();
+                edge_error = std::max({edge_error, (edge_sigmoid.cast<double>() - expected_sigmoid).cwiseAbs().maxCoeff(),
+                                       (edge_softmax.cast<double>() - expected_softmax).cwiseAbs().maxCoeff()});
+            }
+
+            const int repeats = 200;
+            Eigen::MatrixXf work = input.cast<float>();
+            auto start = Clock::now();
+            for (int r = 0; r < repeats; ++r)
+                sigmoid_inplace<float>(work);
+            double ns = seconds_since(start) * 1e9 / (double(repeats) * work.size());
+
+            bool ok = sigmoid_error <= tolerance && softmax_error <= tolerance && backward_error <= tolerance &&
+                      finite && edge_error <= tolerance;
+            std::cout << simd_level_name(static_cast<SimdLevel>(level))
+                      << (mode == ActivationMode::Exact ? " 精确" : " 快速")
+                      << std::scientific << std::setprecision(2)
+                      << " | sigmoid 误差 " << sigmoid_error << " | 导数误差 " << backward_error
+                      << " | softmax 误差 " << softmax_error << " | 尾部/极端输入误差 " << edge_error
+                      << (finite ? "" : "（含非有限值）") << std::fixed << " | sigmoid " << ns << " ns/元素"
+                      << " | " << (ok ? "通过" : "超出容差") << std::endl;
+        }
+    }
+    set_simd_level(original_level);
+    set_activation_mode(original_mode);
+}
+
+
+// int8 量化推理的各个内核：结果必须与标量内核逐位相同，并测量批量吞吐量与逐张延迟。
+// 优先使用已训练的模型与测试集，缺少时用随机网络和随机稀疏图像（只比较内核，不代表准确率）
+void bench_int8(int argc, char* argv[]) {
+    int count = int_option(argc, argv, "--images", 10000);
+    std::unique_ptr<NeuralNetwork> net;
+    if (std::filesystem::exists("../output/model_params.bin")) net = NeuralNetwork::from_file("../output/model_params.bin");
+    if (!net) net.reset(new NeuralNetwork(784, 128, 10));
+    Dataset test;
+    std::vector<uint8_t> pixels;
+    if (test.images.open("../data/t10k-images-idx3-ubyte")) {
+        count = static_cast<int>(std::min<size_t>(count, test.images.size()));
+        pixels.assign(test.images.matrix().data(), test.images.matrix().data() + size_t(count) * 784);
+    } else {
+        std::mt19937 gen(3);
+        std::uniform_int_distribution<int> value(0, 255);
+        pixels.resize(size_t(count) * 784);
+        for (uint8_t& p : pixels) p = gen() % 5 == 0 ? static_cast<uint8_t>(value(gen)) : 0;
+    }
+
+    QuantizedNetwork quantized(*net);
+    quantized.calibrate(pixels.data(), std::min(count, 1000));
+    NeuralNetwork::Matrix reference, probabilities;
+    std::vector<int> float_preds = net->predict_batch(pixels.data(), count, &reference);
+    const int singles = std::min(count, 2000);
+    // 逐张推理的平均延迟（含 uint8 -> float 转换）
+    auto single_latency_us = [&](auto&& predict) {
+        NeuralNetwork::Vector input;
+        int checksum = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < singles; ++i) {
+            input = Eigen::Map<const Eigen::Matrix<uint8_t, Eigen::Dynamic, 1>>(&pixels[size_t(i) * 784], 784).cast<float>() / 255.0f;
+            checksum += predict(input);
+        }
+        double us = seconds_since(start) * 1e6 / singles;
+        return checksum < 0 ? 0.0 : us; // 使用 checksum，防止循环被优化掉
+    };
+
+    auto start = Clock::now();
+    net->predict_batch(pixels.data(), count);
+    double float_time = seconds_since(start);
+    double float_single_us = single_latency_us([&](const NeuralNetwork::Vector& x) { return net->predict(x); });
+    std::cout << std::fixed << std::setprecision(0) << "float | 批量 " << count / float_time << " 张/s"
+              << std::setprecision(2) << " | 逐张 " << float_single_us << " us" << std::endl;
+
+    Int8Kernel original = int8_kernel();
+    NeuralNetwork::Matrix scalar_probabilities;
+    for (int level = 0; level <= static_cast<int>(detected_int8_kernel()); ++level) {
+        set_int8_kernel(static_cast<Int8Kernel>(level));
+        std::vector<int> preds = quantized.predict_batch(pixels.data(), count, &probabilities);
+        if (level == 0) scalar_probabilities = probabilities;
+        start = Clock::now();
+        quantized.predict_batch(pixels.data(), count);
+        double batch_time = seconds_since(start);
+
+        double single_us = single_latency_us([&](const NeuralNetwork::Vector& x) { return quantized.predict(x); });
+
+        int agree = 0;
+        for (int i = 0; i < count; ++i) agree += preds[i] == float_preds[i];
+        std::cout << "int8 " << int8_kernel_name(static_cast<Int8Kernel>(level))
+                  << std::setprecision(0) << " | 批量 " << count / batch_time << " 张/s"
+                  << std::setprecision(2) << " | 逐张 " << single_us << " us"
+                  << " | 与 float 预测一致 " << agree << "/" << count
+                  << std::scientific << " | 概率最大误差 " << (probabilities - reference).cwiseAbs().maxCoeff()
+                  << std::fixed << " | 与标量内核结果相同: " << (probabilities == scalar_probabilities ? "是" : "否")
+                  << std::endl;
+    }
+    set_int8_kernel(original);
+}
+
+// 逐张推理延迟：动态尺寸的 BasicNeuralNetwork 与编译期固定结构的 FixedNetwork（经同一参数文件加载）
+template <typename Scalar>
+void bench_fixed_latency(const std::vector<uint8_t>& pixels, int count, const std::string& path) {
+    std::unique_ptr<BasicNeuralNetwork<Scalar>> net = BasicNeuralNetwork<Scalar>::from_file(path);
+    std::unique_ptr<MnistNetwork<Scalar>> fixed = MnistNetwork<Scalar>::from_file(path);
+    if (!net || !fixed) return;
+    std::vector<typename MnistNetwork<Scalar>::Input> inputs(count);
+    for (int i = 0; i < count; ++i)
+        inputs[i] = Eigen::Map<const Eigen::Matrix<uint8_t, 784, 1>>(&pixels[size_t(i) * 784]).cast<Scalar>() / Scalar(255);
+
+    // 动态网络的输入为 VectorX，预先转换好，两者都只计推理本身
+    std::vector<typename BasicNeuralNetwork<Scalar>::Vector> dynamic_inputs(inputs.begin(), inputs.end());
+    const int rounds = 5;
+    std::vector<int> dynamic_preds(count), fixed_preds(count);
+    auto start = Clock::now();
+    for (int r = 0; r < rounds; ++r)
+        for (int i = 0; i < count; ++i) dynamic_preds[i] = net->predict(dynamic_inputs[i]);
+    double dynamic_us = seconds_since(start) * 1e6 / (double(rounds) * count);
+    start = Clock::now();
+    for (int r = 0; r < rounds; ++r)
+        for (int i = 0; i < count; ++i) fixed_preds[i] = fixed->predict(inputs[i]);
+    double fixed_us = seconds_since(start) * 1e6 / (double(rounds) * count);
+
+    double max_error = 0.0;
+    for (int i = 0; i < count; ++i)
+        max_error = std::max(max_error, static_cast<double>(
+            (fixed->forward(inputs[i]) - net->forward(dynamic_inputs[i])).cwiseAbs().maxCoeff()));
+    int agree = 0;
+    for (int i = 0; i < count; ++i) agree += dynamic_preds[i] == fixed_preds[i];
+    std::cout << (std::is_same<Scalar, float>::value ? "float " : "double") << std::fixed << std::setprecision(2)
+              << " | 动态 " << dynamic_us << " us | 固定 " << fixed_us << " us | 加速 " << dynamic_us / fixed_us << "x"
+              << " | 预测一致 " << agree << "/" << count << std::scientific << " | 概率最大误差 " << max_error
+              << std::fixed << std::endl;
+}
+
+// 编译期固定结构网络与动态网络的逐张推理延迟对比。两者读取同一个参数文件：
+// 优先使用已训练的模型与测试集，缺少时用随机网络和随机稀疏图像
+void bench_fixed(int argc, char* argv[]) {
+    int count = int_option(argc, argv, "--images", 2000);
+    std::string path = "../output/model_params.bin";
+    std::string temp_path = (std::filesystem::temp_directory_path() / "nr_bench_fixed.bin").string();
+    if (!std::filesystem::exists(path)) {
+        if (!NeuralNetwork(784, 128, 10).save_parameters(temp_path)) return;
+        path = temp_path;
+    }
+    Dataset test;
+    std::vector<uint8_t> pixels;
+    if (test.images.open("../data/t10k-images-idx3-ubyte")) {
+        count = static_cast<int>(std::min<size_t>(count, test.images.size()));
+        pixels.assign(test.images.matrix().data(), test.images.matrix().data() + size_t(count) * 784);
+    } else {
+        std::mt19937 gen(5);
+        std::uniform_int_distribution<int> value(1, 255);
+        pixels.resize(size_t(count) * 784);
+        for (uint8_t& p : pixels) p = gen() % 5 == 0 ? static_cast<uint8_t>(value(gen)) : 0;
+    }
+    bench_fixed_latency<float>(pixels, count, path);
+    bench_fixed_latency<double>(pixels, count, path);
+    std::remove(temp_path.c_str());
+}
+
+// 训练步骤的堆内存申请次数：进程级的 malloc 计数（见 alloc_counter.h）。分别用 1024 与 4096 张合成图像训练一个
+// epoch，两次的申请次数之差除以多出的步数即每步的申请次数；训练前的准备（线程池、工作区等）
+// 与数据量无关，两次相同，被差值抵消。各训练路径每步的申请次数都应为 0
+void bench_alloc(int argc, char* argv[]) {
+    if (!allocation_counting_supported()) {
+        std::cout << "当前构建不支持统计内存申请（需要用 cmake -DNR_ALLOC_COUNTER=ON 构建，且为 glibc、未启用 ASan/TSan）" << std::endl;
+        return;
+    }
+    int threads = std::max(2, int_option(argc, argv, "--threads", 4));
+    int batch = std::max(2, int_option(argc, argv, "--batch", 64));
+    const int sizes[2] = {1024, 4096};
+    // 合成的 IDX 图像文件：约 80% 的像素为 0，与 MNIST 相近
+    std::mt19937 gen(5);
+    MnistImages images[2];
+    std::vector<uint8_t> labels[2];
+    SparseImages<float> sparse[2];
+    for (int k = 0; k < 2; ++k) {
+        std::string path = (std::filesystem::temp_directory_path() / "nr_bench_alloc.idx").string();
+        std::vector<uint8_t> bytes(16 + size_t(sizes[k]) * 784);
+        const uint32_t header[4] = {2051, uint32_t(sizes[k]), 28, 28};
+        for (int i = 0; i < 4; ++i)
+            for (int b = 0; b < 4; ++b) bytes[i * 4 + b] = uint8_t(header[i] >> (24 - 8 * b));
+        for (size_t i = 16; i < bytes.size(); ++i) bytes[i] = gen() % 5 == 0 ? uint8_t(gen()) : 0;
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        bool opened = images[k].open(path); // 映射在删除文件后仍然有效
+        std::remove(path.c_str());
+        if (!opened) return;
+        make_sparse_images(images[k], sparse[k]);
+        labels[k].resize(sizes[k]);
+        for (uint8_t& label : labels[k]) label = uint8_t(gen() % 10);
+    }
+
+    struct Config {
+        std::string name;
+        int batch_size, num_threads;
+        bool hogwild, sparse_inputs, layers;
+    };
+    const std::vector<Config> configs = {
+        {"逐样本 SGD", 1, 1, false, false, false},
+        {"逐样本 SGD（稀疏输入）", 1, 1, false, true, false},
+        {"Hogwild " + std::to_string(threads) + " 线程", 1, threads, true, false, false},
+        {"小批量 " + std::to_string(batch) + " 单线程", batch, 1, false, false, false},
+        {"小批量 " + std::to_string(batch) + " 单线程（稀疏输入）", batch, 1, false, true, false},
+        {"小批量 " + std::to_string(batch) + " " + std::to_string(threads) + " 线程", batch, threads, false, false, false},
+        {"Sequential 784-128-10 小批量 " + std::to_string(batch) + " " + std::to_string(threads) + " 线程", batch,
+         threads, false, false, true},
+    };
+    bool all_zero = true;
+    for (const Config& config : configs) {
+        TrainOptions options;
+        options.epochs = 1;
+        options.batch_size = config.batch_size;
+        options.num_threads = config.num_threads;
+        options.hogwild = config.hogwild;
+        size_t counts[2];
+        int steps[2];
+        // 先用小数据集预热一次（工作线程首次运行时的初始化等只发生一次），之后两次才计数
+        for (int k : {0, 0, 1}) {
+            NeuralNetwork net(784, 128, 10);
+            std::unique_ptr<Sequential<float>> model = Sequential<float>::create({784, 128, 10});
+            std::cout.setstate(std::ios::failbit); // 不输出每个 epoch 的统计
+            start_allocation_counting();
+            if (config.layers)
+                model->train(images[k], labels[k], options);
+            else if (config.sparse_inputs)
+                net.train(sparse[k], labels[k], options);
+            else
+                net.train(images[k], labels[k], options);
+            stop_allocation_counting();
+            std::cout.clear();
+            counts[k] = allocation_count();
+            steps[k] = config.hogwild ? sizes[k] / config.num_threads : (sizes[k] + config.batch_size - 1) / config.batch_size;
+        }
+        double per_step = (double(counts[1]) - double(counts[0])) / (steps[1] - steps[0]);
+        all_zero = all_zero && counts[1] == counts[0];
+        std::cout << config.name << " | 训练准备 " << counts[0] << " 次 | 每步 " << std::fixed << std::setprecision(2)
+                  << per_step << " 次" << (counts[1] == counts[0] ? "" : " | 有申请") << std::endl;
+    }
+    std::cout << (all_zero ? "各训练路径每步均不申请堆内存" : "存在每步申请堆内存的训练路径") << std::endl;
+}
+
+// 多层网络（Sequential）：
+//   1. 小网络上用中心差分检查反向传播得到的梯度（扁平参数数组，逐个扰动参数）；
+//   2. 784-128-10 的 Sequential 与 BasicNeuralNetwork 互相读取对方保存的参数文件，推理结果应逐位相同；
+//   3. 有训练集时各训练一个 epoch，对比 784-128-10 两种实现与 784-256-128-10 的训练时间和测试准确率
+void bench_layers(int argc, char* argv[]) {
+    {
+        std::unique_ptr<Sequential<double>> model = Sequential<double>::create({20, 16, 12, 10});
+        std::mt19937 gen(11);
+        Eigen::MatrixXd inputs = (Eigen::MatrixXd::Random(20, 8).array() + 1.0) / 2.0;
+        std::vector<uint8_t> labels(8);
+        for (uint8_t& label : labels) label = static_cast<uint8_t>(gen() % 10);
+        Eigen::VectorXd analytic, ignored;
+        model->loss_and_gradients(inputs, labels.data(), analytic);
+        Eigen::VectorXd& p = model->parameters();
+        const double h = 1e-6;
+        double max_error = 0.0;
+        for (Eigen::Index i = 0; i < p.size(); ++i) {
+            double saved = p(i);
+            p(i) = saved + h;
+            double plus = model->loss_and_gradients(inputs, labels.data(), ignored);
+            p(i) = saved - h;
+            double minus = model->loss_and_gradients(inputs, labels.data(), ignored);
+            p(i) = saved;
+            double numeric = (plus - minus) / (2 * h);
+            max_error = std::max(max_error, std::abs(numeric - analytic(i)) / std::max(1.0, std::abs(numeric)));
+        }
+        std::cout << "梯度检查 20-16-12-10（" << p.size() << " 个参数）| 最大相对误差 " << std::scientific
+                  << std::setprecision(2) << max_error << (max_error < 1e-6 ? " | 通过" : " | 超出容差") << std::endl;
+    }
+    {
+        std::string path = (std::filesystem::temp_directory_path() / "nr_bench_layers.bin").string();
+        NeuralNetwork::Matrix inputs = (NeuralNetwork::Matrix::Random(784, 64).array() + 1.0f) / 2.0f;
+        NeuralNetwork net(784, 128, 10);
+        bool same = false;
+        if (net.save_parameters(path)) {
+            std::unique_ptr<Sequential<float>> model = Sequential<float>::from_file(path);
+            same = model && model->forward_batch(inputs) == net.forward_batch(inputs) && model->save_parameters(path);
+            std::unique_ptr<NeuralNetwork> reloaded = same ? NeuralNetwork::from_file(path) : nullptr;
+            same = same && reloaded && reloaded->forward_batch(inputs) == net.forward_batch(inputs);
+        }
+        std::remove(path.c_str());
+        std::cout << "784-128-10 与 BasicNeuralNetwork 互相读取参数文件，推理结果一致: " << (same ? "是" : "否")
+                  << std::endl;
+    }
+
+    Dataset train, test;
+    if (!load_dataset("../data/train-images-idx3-ubyte", "../data/train-labels-idx1-ubyte", train)) return;
+    bool has_test = load_dataset("../data/t10k-images-idx3-ubyte", "../data/t10k-labels-idx1-ubyte", test);
+    TrainOptions options;
+    options.epochs = 1;
+    options.batch_size = int_option(argc, argv, "--batch", 64);
+    options.num_threads = int_option(argc, argv, "--threads", 1);
+    options.learning_rate = 1.0;
+    auto report = [&](const std::string& name, double seconds, const std::vector<int>& preds) {
+        std::cout << name << std::fixed << std::setprecision(2) << " | 一个 epoch " << seconds << " s";
+        if (has_test) {
+            int correct = 0;
+            for (size_t i = 0; i < preds.size(); ++i) correct += preds[i] == test.labels[i];
+            std::cout << " | 测试准确率 " << 100.0 * correct / preds.size() << "%";
+        }
+        std::cout << std::endl;
+    };
+    const uint8_t* test_pixels = has_test ? test.images.matrix().data() : nullptr;
+    size_t test_count = has_test ? test.images.size() : 0;
+    {
+        NeuralNetwork net(784, 128, 10);
+        auto start = Clock::now();
+        net.train(train.images, train.labels, options);
+        report("BasicNeuralNetwork 784-128-10", seconds_since(start), net.predict_batch(test_pixels, test_count));
+    }
+    for (const std::vector<int>& sizes : {std::vector<int>{784, 128, 10}, std::vector<int>{784, 256, 128, 10}}) {
+        std::unique_ptr<Sequential<float>> model = Sequential<float>::create(sizes);
+        auto start = Clock::now();
+        model->train(train.images, train.labels, options);
+        std::string name = "Sequential ";
+        for (size_t l = 0; l < sizes.size(); ++l) name += (l ? "-" : "") + std::to_string(sizes[l]);
+        report(name, seconds_since(start), model->predict_batch(test_pixels, test_count));
+    }
+}
+} // namespace
+
+void run_benchmark(int argc, char* argv[]) {
+    std::string name = argc > 2 ? argv[2] : "";
+    if (name == "hogwild") {
+        bench_hogwild(argc, argv);
+    } else if (name == "sparse") {
+        bench_sparse(argc, argv);
+    } else if (name == "png") {
+        bench_png(argc, argv);
+    } else if (name == "preprocess") {
+        bench_preprocess(argc, argv);
+    } else if (name == "logging") {
+        bench_logging(argc, argv);
+    } else if (name == "base64") {
+        bench_base64(argc, argv);
+    } else if (name == "reload") {
+        bench_reload(argc, argv);
+    } else if (name == "batching") {
+        bench_batching(argc, argv);
+    } else if (name == "concurrency") {
+        bench_concurrency(argc, argv);
+    } else if (name == "inference") {
+        bench_inference(argc, argv);
+    } else if (name == "startup") {
+        bench_startup(argc, argv);
+    } else if (name == "loader") {
+        bench_loader(argc, argv);
+    } else if (name == "alloc") {
+        bench_alloc(argc, argv);
+    } else if (name == "layers") {
+        bench_layers(argc, argv);
+    } else if (name == "fixed") {
+        bench_fixed(argc, argv);
+    } else if (name == "int8") {
+        bench_int8(argc, argv);
+    } else if (name == "activations") {
+        bench_activations(argc, argv);
+    } else {
+        std::cerr << "用法: ./number_recognition bench hogwild [--epochs N] [--threads N]\n"
+                  << "      ./number_recognition bench sparse [--batch N]\n"
+                  << "      ./number_recognition bench activations [--cols N]\n"
+                  << "      ./number_recognition bench loader\n"
+                  << "      ./number_recognition bench startup [--rounds N]\n"
+                  << "      ./number_recognition bench inference\n"
+                  << "      ./number_recognition bench int8 [--images N]\n"
+                  << "      ./number_recognition bench fixed [--images N]\n"
+                  << "      ./number_recognition bench layers [--batch N] [--threads N]\n"
+                  << "      ./number_recognition bench alloc [--batch N] [--threads N]\n"
+                  << "      ./number_recognition bench concurrency [--threads N] [--rounds N]\n"
+                  << "      ./number_recognition bench batching [--clients N] [--requests N] [--max-batch N] [--max-delay-us N]\n"
+                  << "      ./number_recognition bench reload [--clients N] [--requests N] [--reloads N]\n"
+                  << "      ./number_recognition bench base64 [--bytes N]\n"
+                  << "      ./number_recognition bench logging [--threads N] [--messages N] [--sample N] > /dev/null\n"
+                  << "      ./number_recognition bench preprocess [--images N]\n"
+                  << "      ./number_recognition bench png [--images N]" << std::endl;
+    }
+}
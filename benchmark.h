@@ -0,0 +1,7 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// bench 模式：./number_recognition bench <名称> [参数]
+void run_benchmark(int argc, char* argv[]);
+
+#endif
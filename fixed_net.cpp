@@ -0,0 +1,109 @@
+#include "fixed_net.h"
+#include "model_file.h"
+#include "util.h"
+#include <iostream>
+
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+template <typename DerivedW1, typename DerivedB1, typename DerivedW2, typename DerivedB2>
+void FixedNetwork<Inputs, Hidden, Outputs, Scalar>::assign(const Eigen::MatrixBase<DerivedW1>& w1,
+                                                           const Eigen::MatrixBase<DerivedB1>& v1,
+                                                           const Eigen::MatrixBase<DerivedW2>& w2,
+                                                           const Eigen::MatrixBase<DerivedB2>& v2) {
+    for (int i = 0; i < Inputs; ++i)
+        for (int h = 0; h < Hidden; ++h) W1[i][h] = static_cast<Scalar>(w1(h, i));
+    for (int h = 0; h < Hidden; ++h) b1[h] = static_cast<Scalar>(v1(h));
+    for (int h = 0; h < Hidden; ++h)
+        for (int o = 0; o < Outputs; ++o) W2[h][o] = static_cast<Scalar>(w2(o, h));
+    for (int o = 0; o < Outputs; ++o) b2[o] = static_cast<Scalar>(v2(o));
+}
+
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+std::unique_ptr<FixedNetwork<Inputs, Hidden, Outputs, Scalar>>
+FixedNetwork<Inputs, Hidden, Outputs, Scalar>::from_network(const BasicNeuralNetwork<Scalar>& net) {
+    if (net.num_inputs() != Inputs || net.hidden_bias().size() != Hidden || net.num_outputs() != Outputs) {
+        std::cerr << "网络尺寸 " << net.num_inputs() << "-" << net.hidden_bias().size() << "-" << net.num_outputs()
+                  << " 与 " << Inputs << "-" << Hidden << "-" << Outputs << " 不符" << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<FixedNetwork> fixed(new FixedNetwork());
+    fixed->assign(net.hidden_weights(), net.hidden_bias(), net.output_weights(), net.output_bias());
+    return fixed;
+}
+
+// 新格式从映射的张量复制；旧的无文件头格式交给 BasicNeuralNetwork 解析后再复制
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+std::unique_ptr<FixedNetwork<Inputs, Hidden, Outputs, Scalar>>
+FixedNetwork<Inputs, Hidden, Outputs, Scalar>::from_file(const std::string& filename) {
+    if (!ModelFile::is_model_file(filename)) {
+        std::unique_ptr<BasicNeuralNetwork<Scalar>> net = BasicNeuralNetwork<Scalar>::from_file(filename);
+        return net ? from_network(*net) : nullptr;
+    }
+    ModelFile file;
+    if (!file.open(filename)) return nullptr;
+    auto shape = [&](size_t i, uint32_t rows, uint32_t cols) { return file.rows(i) == rows && file.cols(i) == cols; };
+    if (file.layers() != std::vector<uint32_t>{Inputs, Hidden, Outputs} || file.num_tensors() != 4 ||
+        !shape(0, Hidden, Inputs) || !shape(1, Hidden, 1) || !shape(2, Outputs, Hidden) || !shape(3, Outputs, 1)) {
+        std::cerr << "参数文件的网络结构与 " << Inputs << "-" << Hidden << "-" << Outputs << " 不符: " << filename
+                  << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<FixedNetwork> fixed(new FixedNetwork());
+    fixed->assign(file.read_tensor<Scalar>(0), file.read_tensor<Scalar>(1), file.read_tensor<Scalar>(2),
+                  file.read_tensor<Scalar>(3));
+    return fixed;
+}
+
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+bool FixedNetwork<Inputs, Hidden, Outputs, Scalar>::save_parameters(const std::string& filename) const {
+    // 文件中的张量是紧凑的按列存储矩阵，去掉补齐部分
+    MatrixX<Scalar> w1(Hidden, Inputs), w2(Outputs, Hidden);
+    for (int i = 0; i < Inputs; ++i)
+        for (int h = 0; h < Hidden; ++h) w1(h, i) = W1[i][h];
+    for (int h = 0; h < Hidden; ++h)
+        for (int o = 0; o < Outputs; ++o) w2(o, h) = W2[h][o];
+    return write_model_file<Scalar>(filename, {Inputs, Hidden, Outputs},
+                                    {{w1.data(), Hidden, Inputs}, {b1, Hidden, 1},
+                                     {w2.data(), Outputs, Hidden}, {b2, Outputs, 1}});
+}
+
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+typename FixedNetwork<Inputs, Hidden, Outputs, Scalar>::Output
+FixedNetwork<Inputs, Hidden, Outputs, Scalar>::forward(const Input& input) const {
+    using Chunk = Eigen::Matrix<Scalar, kBlock, 1>;
+    using ChunkMap = Eigen::Map<const Chunk, Eigen::Aligned64>;
+    using OutputChunk = Eigen::Matrix<Scalar, kOutputsPadded, 1>;
+    using OutputMap = Eigen::Map<const OutputChunk, Eigen::Aligned64>;
+
+    // 第一层 hidden = b1 + sum_i x_i * W1[i]，只累加非零输入（MNIST 图像约 80% 的像素为 0）
+    int nonzero[Inputs];
+    int n = 0;
+    for (int i = 0; i < Inputs; ++i) {
+        nonzero[n] = i;
+        n += input(i) != Scalar(0);
+    }
+    alignas(64) Scalar hidden[kHiddenPadded];
+    for (int h0 = 0; h0 < kHiddenPadded; h0 += kBlock) {
+        Chunk acc = ChunkMap(b1 + h0);
+        for (int k = 0; k < n; ++k) {
+            int i = nonzero[k];
+            acc += input(i) * ChunkMap(W1[i] + h0);
+        }
+        Eigen::Map<Chunk, Eigen::Aligned64>(hidden + h0) = acc;
+    }
+    Eigen::Map<MatrixX<Scalar>> activations(hidden, Hidden, 1);
+    sigmoid_inplace<Scalar>(activations);
+
+    OutputChunk z = OutputMap(b2);
+    for (int h = 0; h < Hidden; ++h) z += hidden[h] * OutputMap(W2[h]);
+    Output probabilities = z.template head<Outputs>();
+    softmax_columns_inplace<Scalar>(probabilities);
+    return probabilities;
+}
+
+template <int Inputs, int Hidden, int Outputs, typename Scalar>
+int FixedNetwork<Inputs, Hidden, Outputs, Scalar>::predict(const Input& input) const {
+    return argmax(forward(input));
+}
+
+template class FixedNetwork<784, 128, 10, float>;
+template class FixedNetwork<784, 128, 10, double>;
@@ -0,0 +1,56 @@
+#ifndef FIXED_NET_H
+#define FIXED_NET_H
+
+#include "neural_net.h"
+#include <Eigen/Dense>
+#include <memory>
+#include <string>
+
+// 编译期固定结构的两层网络（只用于推理），与 BasicNeuralNetwork 使用同一种参数文件。
+// 各层尺寸都是常量，参数存放在对象内部 64 字节对齐的定长数组中，循环次数在编译期已知，
+// 编译器可以完全展开并向量化，也不需要运行时的尺寸检查与临时缓冲区。
+// 实现位于 fixed_net.cpp，并为 784-128-10 的 float / double 显式实例化。
+// 对象约为 Inputs x Hidden 个 Scalar（784-128-10 的 float 版本约 400 KB），只能由工厂函数在堆上创建
+template <int Inputs, int Hidden, int Outputs, typename Scalar = float>
+class FixedNetwork {
+public:
+    using Input = Eigen::Matrix<Scalar, Inputs, 1>;
+    using Output = Eigen::Matrix<Scalar, Outputs, 1>;
+
+    // 从参数文件创建（新格式或旧的无文件头格式），结构与模板参数不符或加载失败时返回空指针
+    static std::unique_ptr<FixedNetwork> from_file(const std::string& filename);
+    // 复制动态网络的参数，尺寸不符时返回空指针
+    static std::unique_ptr<FixedNetwork> from_network(const BasicNeuralNetwork<Scalar>& net);
+
+    bool save_parameters(const std::string& filename) const;
+
+    // 与 BasicNeuralNetwork 相同，推理为 const 且可重入（中间结果都在栈上）
+    Output forward(const Input& input) const;
+    int predict(const Input& input) const;
+
+private:
+    // 第一层按隐藏层分块累加，每块 kBlock 个元素（128 字节）在整个输入循环中留在寄存器里
+    static constexpr int kBlock = 128 / sizeof(Scalar);
+    static constexpr int kHiddenPadded = (Hidden + kBlock - 1) / kBlock * kBlock;
+    // 输出层补齐到 64 字节
+    static constexpr int kOutputsPadded = (Outputs * sizeof(Scalar) + 63) / 64 * 64 / sizeof(Scalar);
+
+    FixedNetwork() = default;
+
+    // 按列存储：W1[i] 为输入 i 对应的 Hidden 个权重（即 [Hidden x Inputs] 矩阵的第 i 列），
+    // W2[h] 同理；补齐部分为 0
+    alignas(64) Scalar W1[Inputs][kHiddenPadded] = {};
+    alignas(64) Scalar b1[kHiddenPadded] = {};
+    alignas(64) Scalar W2[Hidden][kOutputsPadded] = {};
+    alignas(64) Scalar b2[kOutputsPadded] = {};
+
+    template <typename DerivedW1, typename DerivedB1, typename DerivedW2, typename DerivedB2>
+    void assign(const Eigen::MatrixBase<DerivedW1>& w1, const Eigen::MatrixBase<DerivedB1>& v1,
+                const Eigen::MatrixBase<DerivedW2>& w2, const Eigen::MatrixBase<DerivedB2>& v2);
+};
+
+// 本项目训练与识别使用的 784-128-10 结构
+template <typename Scalar>
+using MnistNetwork = FixedNetwork<784, 128, 10, Scalar>;
+
+#endif
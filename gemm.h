@@ -0,0 +1,85 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <vector>
+
+// 训练用的矩阵乘法 dst (+)= alpha * lhs * rhs，打包缓冲区由调用方持有并复用。
+// Eigen 的矩阵乘法每次调用都把 lhs/rhs 的分块打包进临时缓冲区：不超过 EIGEN_STACK_ALLOCATION_LIMIT
+// （默认 128 KB）时放在栈上，否则申请堆内存。784 维第一层的乘积需要约 200~400 KB，每个训练步骤都会申请。
+// 这里沿用 Eigen 的分块大小与计算内核（internal::general_matrix_matrix_product），只把缓冲区换成
+// 训练工作区里的 GemmBuffers：第一步按需增长，之后每步复用，各线程的栈占用也不变。
+// 依赖 Eigen 3.4 的内部接口；其他版本退回普通的矩阵乘法（结果相同，只是可能申请内存）
+
+template <typename Scalar>
+class GemmBuffers : public Eigen::internal::level3_blocking<Scalar, Scalar> {
+public:
+    // 按 rows x depth 乘 depth x cols 的乘积计算分块大小（与 Eigen 自己的矩阵乘法相同），缓冲区不够时才增长
+    void prepare(Eigen::Index rows, Eigen::Index cols, Eigen::Index depth) {
+        this->m_mc = rows;
+        this->m_nc = cols;
+        this->m_kc = depth;
+        Eigen::internal::computeProductBlockingSizes<Scalar, Scalar, 1>(this->m_kc, this->m_mc, this->m_nc,
+                                                                        Eigen::Index(1));
+        grow(packed_lhs, this->m_mc * this->m_kc);
+        grow(packed_rhs, this->m_kc * this->m_nc);
+        this->m_blockA = packed_lhs.data();
+        this->m_blockB = packed_rhs.data();
+    }
+
+private:
+    using Buffer = std::vector<Scalar, Eigen::aligned_allocator<Scalar>>;
+
+    static void grow(Buffer& buffer, Eigen::Index size) {
+        if (buffer.size() < static_cast<size_t>(size)) buffer.resize(static_cast<size_t>(size));
+    }
+
+    Buffer packed_lhs, packed_rhs;
+};
+
+// accumulate 为 false 时 dst = alpha * lhs * rhs，否则 dst += alpha * lhs * rhs。
+// dst 须为按列存储、元素连续的矩阵或其 leftCols 等块；lhs/rhs 可以是矩阵、块、Map/Ref 及其转置，
+// 不能含 alias（与 noalias() 相同）
+template <typename Scalar, typename Dest, typename Lhs, typename Rhs>
+void gemm(Dest&& dst, const Lhs& lhs, const Rhs& rhs, Scalar alpha, bool accumulate, GemmBuffers<Scalar>& buffers) {
+    if (!accumulate) dst.setZero();
+    // 矩阵乘向量与很小的乘积 Eigen 不打包，直接计算
+    if (dst.rows() <= 1 || dst.cols() <= 1 || lhs.cols() == 0 ||
+        lhs.cols() + dst.rows() + dst.cols() < EIGEN_GEMM_TO_COEFFBASED_THRESHOLD) {
+        dst.noalias() += alpha * lhs * rhs;
+        return;
+    }
+#if EIGEN_VERSION_AT_LEAST(3, 3, 90)
+    using namespace Eigen;
+    using DestType = typename internal::remove_all<Dest>::type;
+    static_assert(!(DestType::Flags & RowMajorBit) && DestType::InnerStrideAtCompileTime == 1,
+                  "gemm 的结果须按列存储且元素连续");
+    using LhsTraits = internal::blas_traits<Lhs>;
+    using RhsTraits = internal::blas_traits<Rhs>;
+    using ActualLhs = typename LhsTraits::DirectLinearAccessType;
+    using ActualRhs = typename RhsTraits::DirectLinearAccessType;
+    using ActualLhsCleaned = typename internal::remove_all<ActualLhs>::type;
+    using ActualRhsCleaned = typename internal::remove_all<ActualRhs>::type;
+    typename internal::add_const_on_value_type<ActualLhs>::type actual_lhs = LhsTraits::extract(lhs);
+    typename internal::add_const_on_value_type<ActualRhs>::type actual_rhs = RhsTraits::extract(rhs);
+    Scalar actual_alpha = alpha * LhsTraits::extractScalarFactor(lhs) * RhsTraits::extractScalarFactor(rhs);
+
+    using Product = internal::general_matrix_matrix_product<
+        Index,
+        Scalar, (ActualLhsCleaned::Flags & RowMajorBit) ? RowMajor : ColMajor, bool(LhsTraits::NeedToConjugate),
+        Scalar, (ActualRhsCleaned::Flags & RowMajorBit) ? RowMajor : ColMajor, bool(RhsTraits::NeedToConjugate),
+        ColMajor, 1>;
+    using Functor = internal::gemm_functor<Scalar, Index, Product, ActualLhsCleaned, ActualRhsCleaned, DestType,
+                                           GemmBuffers<Scalar>>;
+    buffers.prepare(dst.rows(), dst.cols(), actual_lhs.cols());
+    DestType& out = dst;
+    Functor(actual_lhs, actual_rhs, out, actual_alpha, buffers)(0, dst.rows(), 0, dst.cols());
+#else
+    (void)buffers;
+    dst.noalias() += alpha * lhs * rhs;
+#endif
+}
+
+#endif
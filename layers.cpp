@@ -0,0 +1,114 @@
+#include "layers.h"
+#include <cmath>
+
+namespace {
+
+// 全连接层参数段内的 W [outputs x inputs] 与其后的 b [outputs]
+template <typename Scalar>
+Eigen::Map<const MatrixX<Scalar>> dense_weights(const Scalar* segment, int inputs, int outputs) {
+    return Eigen::Map<const MatrixX<Scalar>>(segment, outputs, inputs);
+}
+template <typename Scalar>
+Eigen::Map<MatrixX<Scalar>> dense_weights(Scalar* segment, int inputs, int outputs) {
+    return Eigen::Map<MatrixX<Scalar>>(segment, outputs, inputs);
+}
+template <typename Scalar>
+Eigen::Map<const VectorX<Scalar>> dense_bias(const Scalar* segment, int inputs, int outputs) {
+    return Eigen::Map<const VectorX<Scalar>>(segment + size_t(outputs) * inputs, outputs);
+}
+template <typename Scalar>
+Eigen::Map<VectorX<Scalar>> dense_bias(Scalar* segment, int inputs, int outputs) {
+    return Eigen::Map<VectorX<Scalar>>(segment + size_t(outputs) * inputs, outputs);
+}
+
+} // namespace
+
+template <typename Scalar>
+void Dense<Scalar>::initialize(Scalar* parameters, std::mt19937& gen) const {
+    std::normal_distribution<double> dist(0, 1.0);
+    const double scale = std::sqrt(1.0 / this->input_size());
+    auto W = dense_weights<Scalar>(parameters + this->offset(), this->input_size(), this->output_size());
+    for (Eigen::Index j = 0; j < W.cols(); ++j)
+        for (Eigen::Index i = 0; i < W.rows(); ++i)
+            W(i, j) = static_cast<Scalar>(dist(gen) * scale);
+    dense_bias<Scalar>(parameters + this->offset(), this->input_size(), this->output_size()).setZero();
+}
+
+template <typename Scalar>
+void Dense<Scalar>::forward(const Scalar* parameters, const ConstRef& input, MutableRef output,
+                            GemmBuffers<Scalar>& buffers) const {
+    const Scalar* segment = parameters + this->offset();
+    gemm(output, dense_weights<Scalar>(segment, this->input_size(), this->output_size()), input, Scalar(1), false,
+         buffers);
+    output.colwise() += dense_bias<Scalar>(segment, this->input_size(), this->output_size());
+}
+
+template <typename Scalar>
+void Dense<Scalar>::backward(const Scalar* parameters, const ConstRef& input, const ConstRef&,
+                             const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                             Scalar* gradients, GemmBuffers<Scalar>& buffers) const {
+    // dW += dZ * X^T，db += dZ 按行求和；dX = W^T * dZ
+    Scalar* grad_segment = gradients + this->offset();
+    gemm(dense_weights<Scalar>(grad_segment, this->input_size(), this->output_size()), output_grad,
+         input.transpose(), Scalar(1), true, buffers);
+    dense_bias<Scalar>(grad_segment, this->input_size(), this->output_size()).noalias() +=
+        output_grad.rowwise().sum();
+    if (propagate) {
+        const Scalar* segment = parameters + this->offset();
+        gemm(input_grad, dense_weights<Scalar>(segment, this->input_size(), this->output_size()).transpose(),
+             output_grad, Scalar(1), false, buffers);
+    }
+}
+
+template <typename Scalar>
+void Sigmoid<Scalar>::forward(const Scalar*, const ConstRef& input, MutableRef output, GemmBuffers<Scalar>&) const {
+    output = input;
+    sigmoid_inplace<Scalar>(output);
+}
+
+template <typename Scalar>
+void Sigmoid<Scalar>::backward(const Scalar*, const ConstRef&, const ConstRef& output,
+                               const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                               Scalar*, GemmBuffers<Scalar>&) const {
+    if (!propagate) return;
+    input_grad = output_grad;
+    multiply_sigmoid_derivative<Scalar>(input_grad, output);
+}
+
+template <typename Scalar>
+void SoftmaxCrossEntropy<Scalar>::forward(const Scalar*, const ConstRef& input, MutableRef output,
+                                          GemmBuffers<Scalar>&) const {
+    output = input;
+    softmax_columns_inplace<Scalar>(output);
+}
+
+template <typename Scalar>
+void SoftmaxCrossEntropy<Scalar>::backward(const Scalar*, const ConstRef&, const ConstRef& output,
+                                           const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                                           Scalar*, GemmBuffers<Scalar>&) const {
+    // softmax 的雅可比矩阵乘积：dz = p * (g - sum(g * p))，逐列计算
+    if (!propagate) return;
+    input_grad = (output_grad.rowwise() - output.cwiseProduct(output_grad).colwise().sum()).cwiseProduct(output);
+}
+
+template <typename Scalar>
+double SoftmaxCrossEntropy<Scalar>::loss_gradient(const ConstRef& probabilities, const uint8_t* labels,
+                                                  MutableRef input_grad, int& correct) const {
+    // dZ = P - onehot(y)：复制概率后只需在标签处减 1
+    input_grad = probabilities;
+    double loss = 0.0;
+    for (Eigen::Index j = 0; j < probabilities.cols(); ++j) {
+        int label = labels[j];
+        loss += cross_entropy_loss(probabilities.col(j), label);
+        if (argmax(probabilities.col(j)) == label) correct++;
+        input_grad(label, j) -= Scalar(1);
+    }
+    return loss;
+}
+
+template class Dense<float>;
+template class Dense<double>;
+template class Sigmoid<float>;
+template class Sigmoid<double>;
+template class SoftmaxCrossEntropy<float>;
+template class SoftmaxCrossEntropy<double>;
@@ -0,0 +1,107 @@
+#ifndef LAYERS_H
+#define LAYERS_H
+
+#include "util.h"
+#include "gemm.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+// 网络层（Scalar 为 float 或 double，实现位于 layers.cpp 并显式实例化）。
+// 层本身不保存参数：模型的全部参数连续存放在一个扁平数组中，每层只记录自己那一段的起点 offset，
+// 前向/反向传播时传入整个参数数组；梯度数组与参数数组布局相同，同一个 offset 即为该层的梯度。
+// 矩阵的每一列是一个样本；各函数都可能只作用于工作区的前 n 列。
+// buffers 为矩阵乘法的打包缓冲区（见 gemm.h），由调用方的工作区持有，只有全连接层用到
+template <typename Scalar>
+class Layer {
+public:
+    using Matrix = MatrixX<Scalar>;
+    using ConstRef = Eigen::Ref<const Matrix>;
+    using MutableRef = Eigen::Ref<Matrix>;
+
+    virtual ~Layer() = default;
+
+    int input_size() const { return inputs; }
+    int output_size() const { return outputs; }
+    // 在扁平参数数组中占用 [offset(), offset() + num_parameters())
+    virtual size_t num_parameters() const { return 0; }
+    size_t offset() const { return parameter_offset; }
+    void set_offset(size_t offset) { parameter_offset = offset; }
+
+    virtual void initialize(Scalar* /*parameters*/, std::mt19937& /*gen*/) const {}
+    // output [output_size x n] 由 input [input_size x n] 计算
+    virtual void forward(const Scalar* parameters, const ConstRef& input, MutableRef output,
+                         GemmBuffers<Scalar>& buffers) const = 0;
+    // output_grad 为损失对本层输出的梯度。参数梯度累加到 gradients 中本层的一段；
+    // propagate 为 true 时把损失对本层输入的梯度写入 input_grad（第一层不需要）
+    virtual void backward(const Scalar* parameters, const ConstRef& input, const ConstRef& output,
+                          const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                          Scalar* gradients, GemmBuffers<Scalar>& buffers) const = 0;
+
+protected:
+    Layer(int inputs, int outputs) : inputs(inputs), outputs(outputs) {}
+
+private:
+    int inputs, outputs;
+    size_t parameter_offset = 0;
+};
+
+// 全连接层 output = W * input + b。参数段内先存 W [outputs x inputs]（按列存储），后接 b [outputs]
+template <typename Scalar>
+class Dense : public Layer<Scalar> {
+public:
+    using typename Layer<Scalar>::ConstRef;
+    using typename Layer<Scalar>::MutableRef;
+
+    Dense(int inputs, int outputs) : Layer<Scalar>(inputs, outputs) {}
+
+    size_t num_parameters() const override { return size_t(this->output_size()) * (this->input_size() + 1); }
+
+    // Xavier 初始化：W ~ N(0, 1 / inputs)，b = 0
+    void initialize(Scalar* parameters, std::mt19937& gen) const override;
+    void forward(const Scalar* parameters, const ConstRef& input, MutableRef output,
+                 GemmBuffers<Scalar>& buffers) const override;
+    void backward(const Scalar* parameters, const ConstRef& input, const ConstRef& output,
+                  const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                  Scalar* gradients, GemmBuffers<Scalar>& buffers) const override;
+};
+
+// sigmoid 激活，没有参数；反向传播由输出 a 直接得到导数 a * (1 - a)
+template <typename Scalar>
+class Sigmoid : public Layer<Scalar> {
+public:
+    using typename Layer<Scalar>::ConstRef;
+    using typename Layer<Scalar>::MutableRef;
+
+    explicit Sigmoid(int size) : Layer<Scalar>(size, size) {}
+
+    void forward(const Scalar* parameters, const ConstRef& input, MutableRef output,
+                 GemmBuffers<Scalar>& buffers) const override;
+    void backward(const Scalar* parameters, const ConstRef& input, const ConstRef& output,
+                  const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                  Scalar* gradients, GemmBuffers<Scalar>& buffers) const override;
+};
+
+// 输出层：前向为按列 softmax。训练时与交叉熵损失合并求梯度（loss_gradient：dZ = P - onehot(y)），
+// 比先求损失对概率的梯度再乘 softmax 的雅可比矩阵更稳定；backward 为一般的雅可比矩阵乘积
+template <typename Scalar>
+class SoftmaxCrossEntropy : public Layer<Scalar> {
+public:
+    using typename Layer<Scalar>::ConstRef;
+    using typename Layer<Scalar>::MutableRef;
+
+    explicit SoftmaxCrossEntropy(int size) : Layer<Scalar>(size, size) {}
+
+    void forward(const Scalar* parameters, const ConstRef& input, MutableRef output,
+                 GemmBuffers<Scalar>& buffers) const override;
+    void backward(const Scalar* parameters, const ConstRef& input, const ConstRef& output,
+                  const ConstRef& output_grad, MutableRef input_grad, bool propagate,
+                  Scalar* gradients, GemmBuffers<Scalar>& buffers) const override;
+
+    // probabilities 为 forward 的输出，labels 为各列的类别下标；input_grad 写入损失对 softmax 输入的梯度，
+    // 返回交叉熵损失之和，预测正确的个数累加到 correct
+    double loss_gradient(const ConstRef& probabilities, const uint8_t* labels, MutableRef input_grad,
+                         int& correct) const;
+};
+
+#endif
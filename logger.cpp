@@ -0,0 +1,172 @@
+#include "logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// 有界多生产者单消费者环形缓冲区（Vyukov 的序号槽位方案）：
+// 生产者用 CAS 抢占写位置，写完后发布槽位序号；消费者按序号判断槽位是否可读
+class LogRing {
+public:
+    static const size_t kCapacity = 4096;   // 槽位数，必须是 2 的幂
+    static const size_t kMessageSize = 240; // 单条消息最大长度
+
+    LogRing() {
+        for (size_t i = 0; i < kCapacity; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(LogLevel level, std::string_view message) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & (kCapacity - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // 已满
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->level = level;
+        slot->length = std::min(message.size(), kMessageSize);
+        std::memcpy(slot->text, message.data(), slot->length);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 仅由后台线程调用；取出一条消息写到输出，没有可读消息时返回 false
+    bool pop_and_write() {
+        Slot& slot = slots[dequeue_pos & (kCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) return false;
+        static const char* tags[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+        FILE* out = slot.level >= LogLevel::Warn ? stderr : stdout;
+        std::fprintf(out, "[%s] %.*s\n", tags[static_cast<int>(slot.level)],
+                     static_cast<int>(slot.length), slot.text);
+        slot.sequence.store(dequeue_pos + kCapacity, std::memory_order_release);
+        ++dequeue_pos;
+        written.store(dequeue_pos, std::memory_order_release);
+        return true;
+    }
+
+    size_t pushed() const { return enqueue_pos.load(std::memory_order_acquire); }
+    size_t drained() const { return written.load(std::memory_order_acquire); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        size_t length;
+        char text[kMessageSize];
+    };
+
+    Slot slots[kCapacity];
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) size_t dequeue_pos = 0;
+    std::atomic<size_t> written{0};
+};
+
+// 后台写日志的线程，第一次记录消息时启动，程序退出时写完剩余消息后结束
+class Logger {
+public:
+    Logger() : worker(&Logger::run, this) {}
+    ~Logger() {
+        stopping.store(true, std::memory_order_release);
+        worker.join();
+        size_t lost = dropped.load();
+        if (lost > 0) std::fprintf(stderr, "[WARN] 日志缓冲区已满，丢弃了 %zu 条消息\n", lost);
+    }
+
+    void push(LogLevel level, std::string_view message) {
+        if (!ring.push(level, message)) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+
+    void flush() {
+        size_t target = ring.pushed();
+        while (ring.drained() < target) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+private:
+    // 没有消息时短暂休眠而不是等待条件变量，生产者因此不需要任何加锁或通知
+    void run() {
+        for (;;) {
+            bool any = false;
+            while (ring.pop_and_write()) any = true;
+            if (any) {
+                std::fflush(stdout);
+                std::fflush(stderr);
+            } else if (stopping.load(std::memory_order_acquire)) {
+                return;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    LogRing ring;
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+};
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+std::atomic<LogLevel> g_log_level{LogLevel::Info};
+std::atomic<int> g_sample_rate{1};
+std::atomic<unsigned> g_debug_counter{0};
+
+} // namespace
+
+void set_log_level(LogLevel level) { g_log_level.store(level); }
+LogLevel log_level() { return g_log_level.load(); }
+void set_log_sample_rate(int n) { g_sample_rate.store(std::max(1, n)); }
+
+bool parse_log_level(std::string_view name, LogLevel& level) {
+    const std::pair<const char*, LogLevel> names[] = {
+        {"debug", LogLevel::Debug}, {"info", LogLevel::Info}, {"warn", LogLevel::Warn},
+        {"error", LogLevel::Error}, {"off", LogLevel::Off}};
+    for (const auto& entry : names) {
+        if (name == entry.first) {
+            level = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool log_enabled(LogLevel level) {
+    if (level == LogLevel::Off || level < g_log_level.load(std::memory_order_relaxed)) return false;
+    if (level != LogLevel::Debug) return true;
+    int rate = g_sample_rate.load(std::memory_order_relaxed);
+    return rate == 1 || g_debug_counter.fetch_add(1, std::memory_order_relaxed) % rate == 0;
+}
+
+std::ostringstream& log_stream() {
+    static thread_local std::ostringstream stream;
+    stream.str(std::string());
+    stream.clear();
+    return stream;
+}
+
+void log_message(LogLevel level, std::string_view message) {
+    logger().push(level, message);
+}
+
+void flush_log() {
+    logger().flush();
+}
+
+size_t log_dropped_count() {
+    return logger().dropped_count();
+}
@@ -0,0 +1,46 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <cstddef>
+#include <sstream>
+#include <string_view>
+
+// 异步日志：调用方只把格式化好的消息放入无锁环形缓冲区，由后台线程统一写到 stdout/stderr，
+// 请求处理线程不会阻塞在输出流的锁或 I/O 上。缓冲区满时丢弃新消息（退出前汇报丢弃数）。
+enum class LogLevel { Debug, Info, Warn, Error, Off };
+
+// 低于该级别的消息直接丢弃（默认 Info）
+void set_log_level(LogLevel level);
+LogLevel log_level();
+// Debug 级别消息的采样率：每 n 条只记录 1 条（默认 1，即全部记录）
+void set_log_sample_rate(int n);
+// 解析 "debug"/"info"/"warn"/"error"/"off"，无法识别时返回 false
+bool parse_log_level(std::string_view name, LogLevel& level);
+
+// 该级别的消息是否需要记录（包含 Debug 采样），调用方据此跳过消息的格式化
+bool log_enabled(LogLevel level);
+// 放入缓冲区，超长消息会被截断
+void log_message(LogLevel level, std::string_view message);
+// 阻塞直到此前放入的消息都已写出
+void flush_log();
+// 因缓冲区满而丢弃的消息数
+size_t log_dropped_count();
+
+// 当前线程复用的格式化流（已清空），避免每条消息都构造 ostringstream
+std::ostringstream& log_stream();
+
+// 例如 LOG_INFO("加载模型参数: " << path)，未启用的级别不会格式化消息
+#define NR_LOG(level, expr)                                  \
+    do {                                                     \
+        if (log_enabled(level)) {                            \
+            std::ostringstream& nr_log_stream_ = log_stream(); \
+            nr_log_stream_ << expr;                          \
+            log_message(level, nr_log_stream_.str());        \
+        }                                                    \
+    } while (0)
+#define LOG_DEBUG(expr) NR_LOG(LogLevel::Debug, expr)
+#define LOG_INFO(expr) NR_LOG(LogLevel::Info, expr)
+#define LOG_WARN(expr) NR_LOG(LogLevel::Warn, expr)
+#define LOG_ERROR(expr) NR_LOG(LogLevel::Error, expr)
+
+#endif
@@ -1,18 +1,111 @@
 #include "mnist_loader.h"
 #include "neural_net.h"
+#include "quantized_net.h"
+#include "sequential.h"
+#include "benchmark.h"
+#include "web_server.h"
+#include "logger.h"
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <string>
+#include <cstdlib>
 
-void train_model() {
-    std::vector<Eigen::VectorXd> train_images, train_labels;
+// train 模式的命令行参数
+struct TrainCommand {
+    TrainOptions options;
+    bool sparse = false; // 以稀疏形式加载训练图像，第一层只处理非零像素
+    std::vector<int> layers; // 非空时训练任意层数的网络（Sequential），例如 784,256,128,10
+};
+
+// 解析逗号分隔的各层神经元数，例如 "784,256,128,10"；无法解析的项为 0，由 Sequential::create 报错
+static std::vector<int> parse_layer_sizes(const std::string& text) {
+    std::vector<int> sizes;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == std::string::npos) end = text.size();
+        sizes.push_back(std::atoi(text.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return sizes;
+}
+
+// 解析 train 模式的可选参数，例如 ./number_recognition train --batch 64 --lr 0.5 --threads 8
+static TrainCommand parse_train_options(int argc, char* argv[]) {
+    TrainCommand command;
+    TrainOptions& options = command.options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--epochs") options.epochs = std::atoi(value);
+        else if (key == "--lr") options.learning_rate = std::atof(value);
+        else if (key == "--batch") options.batch_size = std::atoi(value);
+        else if (key == "--threads") options.num_threads = std::atoi(value);
+        else if (key == "--hogwild") options.hogwild = std::atoi(value) != 0;
+        else if (key == "--sparse") command.sparse = std::atoi(value) != 0;
+        else if (key == "--layers") command.layers = parse_layer_sizes(value);
+        else if (key == "--fast-exp") set_activation_mode(std::atoi(value) ? ActivationMode::Fast : ActivationMode::Exact);
+        else std::cerr << "忽略未知参数: " << key << std::endl;
+    }
+    return command;
+}
+
+// test 模式的命令行参数
+struct TestCommand {
+    bool int8 = false;      // 同时评估 int8 量化推理，并与 double / float 对比
+    int calibration = 1000; // 用测试集的前 N 张图像校准隐藏层激活的量化范围
+};
+
+// 解析 test 模式的可选参数，例如 ./number_recognition test --int8 1 --calib 1000
+static TestCommand parse_test_options(int argc, char* argv[]) {
+    TestCommand command;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--int8") command.int8 = std::atoi(value) != 0;
+        else if (key == "--calib") command.calibration = std::atoi(value);
+        else std::cerr << "忽略未知参数: " << key << std::endl;
+    }
+    return command;
+}
+
+// 解析 try 模式的可选参数，例如 ./number_recognition try --max-batch 64 --max-delay-us 1000 --log-level debug
+static ServerOptions parse_server_options(int argc, char* argv[]) {
+    ServerOptions options;
+    BatchOptions& batching = options.batching;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        LogLevel level;
+        if (key == "--max-batch") batching.max_batch = std::atoi(value);
+        else if (key == "--max-delay-us") batching.max_delay_us = std::atoi(value);
+        else if (key == "--log-level") {
+            if (parse_log_level(value, level)) set_log_level(level);
+            else std::cerr << "无效的日志级别: " << value << "（可选 debug、info、warn、error、off），保持当前级别"
+                           << std::endl;
+        } else if (key == "--log-sample") set_log_sample_rate(std::atoi(value));
+        else if (key == "--model-poll-ms") options.model_poll_ms = std::atoi(value);
+        else if (key == "--max-raw-batch") options.max_raw_batch = std::atoi(value);
+        else std::cerr << "忽略未知参数: " << key << std::endl;
+    }
+    return options;
+}
+
+void train_model(const TrainCommand& command) {
+    const TrainOptions& options = command.options;
+    MnistImages train_images; // mmap 映射，像素保持 uint8，训练时按样本/按批转换
+    std::vector<uint8_t> train_labels;
+    SparseImages<float> sparse_images;
     std::string train_image_path = "../data/train-images-idx3-ubyte";
     std::string train_label_path = "../data/train-labels-idx1-ubyte";
 
     std::cout << "正在打开训练集数据: " << train_image_path << std::endl;
     std::cout << "正在打开标签集数据: " << train_label_path << std::endl;
 
-    bool ok1 = load_mnist_images(train_image_path, train_images);
-    bool ok2 = load_mnist_labels(train_label_path, train_labels, 10);
+    bool ok1 = train_images.open(train_image_path);
+    if (ok1 && command.sparse) make_sparse_images(train_images, sparse_images);
+    bool ok2 = load_mnist_labels(train_label_path, train_labels);
 
     if (!ok1 || !ok2) {
         std::cerr << "无法打开！" << std::endl;
@@ -22,22 +115,120 @@ void train_model() {
     std::cout << "加载成功 " << train_images.size() << " 个图像和 "
               << train_labels.size() << " 个标签" << std::endl;
 
+    if (!command.layers.empty()) {
+        if (command.layers.size() < 2 || command.layers.front() != train_images.pixels() || command.layers.back() != 10) {
+            std::cerr << "网络结构的输入层应为 " << train_images.pixels() << "，输出层应为 10" << std::endl;
+            return;
+        }
+        if (command.sparse) std::cerr << "多层网络不支持稀疏输入，将使用稠密输入" << std::endl;
+        std::unique_ptr<Sequential<float>> model = Sequential<float>::create(command.layers);
+        if (!model) return;
+        std::cout << "训练参数: 网络结构 ";
+        for (size_t l = 0; l < command.layers.size(); ++l) std::cout << (l ? "-" : "") << command.layers[l];
+        std::cout << "（" << model->parameters().size() << " 个参数） epochs=" << options.epochs
+                  << " lr=" << options.learning_rate << " batch=" << options.batch_size
+                  << " threads=" << options.num_threads << std::endl;
+        model->train(train_images, train_labels, options);
+        if (model->save_parameters("../output/model_params.bin"))
+            std::cout << "模型参数已储存" << std::endl;
+        return;
+    }
+
+    // 网络在 train 中也会检查输入维度，这里提前退出，避免用未训练的参数覆盖已保存的模型
+    if (train_images.pixels() != 784) {
+        std::cerr << "训练图像的像素数应为 784（28x28），实际为 " << train_images.pixels() << std::endl;
+        return;
+    }
     NeuralNetwork net(784, 128, 10);
-    net.train(train_images, train_labels, 10, 0.1);
-    net.save_parameters("../output/model_params.bin");
-    std::cout << "模型参数已储存" << std::endl;
+    std::cout << "训练参数: epochs=" << options.epochs << " lr=" << options.learning_rate
+              << " batch=" << options.batch_size << " threads=" << options.num_threads
+              << (options.hogwild ? " (Hogwild)" : "") << (command.sparse ? " (稀疏输入)" : "")
+              << " 激活函数: " << simd_level_name(simd_level())
+              << (activation_mode() == ActivationMode::Fast ? " 快速 exp" : "") << std::endl;
+    if (command.sparse)
+        net.train(sparse_images, train_labels, options);
+    else
+        net.train(train_images, train_labels, options);
+    if (net.save_parameters("../output/model_params.bin"))
+        std::cout << "模型参数已储存" << std::endl;
 }
 
-void test_model() {
-    std::vector<Eigen::VectorXd> test_images, test_labels;
+// 一种推理实现在测试集上的结果：准确率、整个测试集批量推理的吞吐量、逐张推理的平均延迟
+struct Evaluation {
+    std::vector<int> preds;
+    double accuracy = 0.0;
+    double images_per_second = 0.0;
+    double latency_us = 0.0;
+};
+
+template <typename Net>
+Evaluation evaluate(const Net& net, const MnistImages& images, const std::vector<uint8_t>& labels) {
+    using Clock = std::chrono::steady_clock;
+    Evaluation result;
+    auto start = Clock::now();
+    result.preds = net.predict_batch(images.matrix().data(), images.size());
+    result.images_per_second = images.size() / std::chrono::duration<double>(Clock::now() - start).count();
+    int correct = 0;
+    for (size_t i = 0; i < result.preds.size(); ++i)
+        if (result.preds[i] == labels[i]) correct++;
+    result.accuracy = 100.0 * correct / images.size();
+
+    // 逐张延迟：图像预先转换为浮点向量，只计推理本身
+    size_t count = std::min<size_t>(images.size(), 1000);
+    using Vector = typename Net::Vector;
+    std::vector<Vector> inputs(count);
+    for (size_t i = 0; i < count; ++i)
+        inputs[i] = images.image(i).cast<typename Vector::Scalar>() / typename Vector::Scalar(255);
+    int checksum = 0;
+    start = Clock::now();
+    for (const Vector& input : inputs) checksum += net.predict(input);
+    result.latency_us = std::chrono::duration<double>(Clock::now() - start).count() * 1e6 / count;
+    if (checksum < 0) std::cout << checksum; // 防止循环被优化掉
+    return result;
+}
+
+// double / float / int8 三种推理的准确率与速度对比，int8 先用测试集的前 calibration 张图像校准
+void compare_int8(const MnistImages& images, const std::vector<uint8_t>& labels, int calibration) {
+    const std::string path = "../output/model_params.bin";
+    std::unique_ptr<BasicNeuralNetwork<double>> net64 = BasicNeuralNetwork<double>::from_file(path);
+    std::unique_ptr<NeuralNetwork> net32 = NeuralNetwork::from_file(path);
+    if (!net64 || !net32) return;
+
+    QuantizedNetwork quantized(*net32);
+    size_t calibration_count = std::min<size_t>(images.size(), static_cast<size_t>(std::max(calibration, 0)));
+    quantized.calibrate(images.matrix().data(), calibration_count);
+    std::cout << "int8 校准: " << calibration_count << " 张图像，隐藏层激活范围 [0, " << quantized.hidden_range()
+              << "]，权重 " << quantized.weight_bytes() / 1024 << " KiB，内核 " << int8_kernel_name(int8_kernel())
+              << std::endl;
+
+    Evaluation e64 = evaluate(*net64, images, labels);
+    Evaluation e32 = evaluate(*net32, images, labels);
+    Evaluation e8 = evaluate(quantized, images, labels);
+    auto print = [](const char* name, const Evaluation& e) {
+        std::cout << std::fixed << std::setprecision(2) << name << " | 准确率 " << e.accuracy << "%"
+                  << std::setprecision(0) << " | 批量 " << e.images_per_second << " 张/s"
+                  << std::setprecision(2) << " | 逐张 " << e.latency_us << " us" << std::endl;
+    };
+    print("double", e64);
+    print("float ", e32);
+    print("int8  ", e8);
+    int agree = 0;
+    for (size_t i = 0; i < e8.preds.size(); ++i)
+        if (e8.preds[i] == e64.preds[i]) agree++;
+    std::cout << "int8 与 double 预测一致: " << agree << "/" << e8.preds.size() << std::endl;
+}
+
+void test_model(const TestCommand& command) {
+    MnistImages test_images;
+    std::vector<uint8_t> test_labels;
     std::string test_image_path = "../data/t10k-images-idx3-ubyte";
     std::string test_label_path = "../data/t10k-labels-idx1-ubyte";
 
     std::cout << "正在打开测试图像: " << test_image_path << std::endl;
     std::cout << "正在打开测试标签: " << test_label_path << std::endl;
 
-    bool ok1 = load_mnist_images(test_image_path, test_images);
-    bool ok2 = load_mnist_labels(test_label_path, test_labels, 10);
+    bool ok1 = test_images.open(test_image_path);
+    bool ok2 = load_mnist_labels(test_label_path, test_labels);
 
     if (!ok1 || !ok2) {
         std::cerr << "正在加载测试集数据" << std::endl;
@@ -47,28 +238,48 @@ void test_model() {
     std::cout << "加载成功 " << test_images.size() << " 个测试数据和 "
               << test_labels.size() << " 个测试标签" << std::endl;
 
-    NeuralNetwork net(784, 128, 10);
-    net.load_parameters("../output/model_params.bin");
+    // 层数与尺寸取自参数文件，不做随机初始化；两层与更深的网络都可评估
+    std::unique_ptr<Sequential<float>> net = Sequential<float>::from_file("../output/model_params.bin");
+    if (!net) return;
+    if (test_images.pixels() != net->num_inputs()) {
+        std::cerr << "测试图像的像素数 " << test_images.pixels() << " 与模型输入维度 " << net->num_inputs() << " 不符"
+                  << std::endl;
+        return;
+    }
 
+    // 整个测试集按块做矩阵乘矩阵，不再逐张做矩阵乘向量
+    std::vector<int> preds = net->predict_batch(test_images.matrix().data(), test_images.size());
     int correct = 0;
-    for (size_t i = 0; i < test_images.size(); ++i) {
-        int pred = net.predict(test_images[i]);
-        int label_index;
-        test_labels[i].maxCoeff(&label_index);
-        if (pred == label_index) correct++;
-    }
+    for (size_t i = 0; i < preds.size(); ++i)
+        if (preds[i] == test_labels[i]) correct++;
     double accuracy = 100.0 * correct / test_images.size();
     std::cout << "测试准确率: " << accuracy << "% (" << correct << "/" << test_images.size() << ")" << std::endl;
+
+    if (command.int8) compare_int8(test_images, test_labels, command.calibration);
+}
+
+// 把参数文件转换为当前默认精度（float）的新格式保存，可读取旧的无文件头 double/float 格式 model_params.bin
+void convert_model(const std::string& input_path, const std::string& output_path) {
+    std::unique_ptr<Sequential<float>> net = Sequential<float>::from_file(input_path);
+    if (!net || !net->save_parameters(output_path)) return;
+    std::cout << "已转换模型参数: " << input_path << " -> " << output_path << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     if (argc > 1 && std::string(argv[1]) == "train") {
-        train_model();
+        train_model(parse_train_options(argc, argv));
     } else if (argc > 1 && std::string(argv[1]) == "try") {
-        extern void run_server();
-        run_server();
+        run_server(parse_server_options(argc, argv));
+    } else if (argc > 1 && std::string(argv[1]) == "convert") {
+        if (argc < 4) {
+            std::cerr << "用法: ./number_recognition convert <输入参数文件> <输出参数文件>" << std::endl;
+            return 1;
+        }
+        convert_model(argv[2], argv[3]);
+    } else if (argc > 1 && std::string(argv[1]) == "bench") {
+        run_benchmark(argc, argv);
     } else {
-        test_model();
+        test_model(parse_test_options(argc, argv));
     }
     return 0;
 }
@@ -0,0 +1,57 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+Histogram::Histogram(std::vector<double> upper_bounds)
+    : bounds(std::move(upper_bounds)), buckets(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+    std::sort(bounds.begin(), bounds.end());
+    for (size_t i = 0; i <= bounds.size(); ++i) buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void Histogram::observe(double value) {
+    // 最后一个桶为 +Inf
+    size_t index = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::write(std::string& out, const std::string& name, const std::string& labels) const {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    uint64_t cumulative = 0;
+    char bound[32];
+    for (size_t i = 0; i <= bounds.size(); ++i) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        if (i < bounds.size()) std::snprintf(bound, sizeof(bound), "%g", bounds[i]);
+        else std::snprintf(bound, sizeof(bound), "+Inf");
+        write_metric_sample(out, name + "_bucket", prefix + "le=\"" + bound + "\"", static_cast<double>(cumulative));
+    }
+    write_metric_sample(out, name + "_sum", labels, sum.load(std::memory_order_relaxed));
+    write_metric_sample(out, name + "_count", labels, static_cast<double>(count.load(std::memory_order_relaxed)));
+}
+
+std::vector<double> Histogram::latency_buckets() {
+    return {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 1.0};
+}
+
+std::vector<double> Histogram::size_buckets() {
+    return {1, 2, 4, 8, 16, 32, 64, 128, 256};
+}
+
+void write_metric_header(std::string& out, const std::string& name, const char* type, const char* help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void write_metric_sample(std::string& out, const std::string& name, const std::string& labels, double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.17g", value);
+    out += name;
+    if (!labels.empty()) out += "{" + labels + "}";
+    out += " ";
+    out += number;
+    out += "\n";
+}
@@ -0,0 +1,81 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Prometheus 文本格式的监控指标。所有更新都是无锁的原子操作，可在任意线程调用
+
+// 只增不减的计数
+class Counter {
+public:
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// 可增可减的当前值，例如正在处理的请求数
+class Gauge {
+public:
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+// 固定桶边界的直方图：observe 只做一次桶查找和几次原子加
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> upper_bounds);
+
+    void observe(double value);
+    // 写出 name_bucket{le=...}、name_sum、name_count 三组样本，labels 形如 stage="decode"（可为空）
+    void write(std::string& out, const std::string& name, const std::string& labels) const;
+
+    // 常用的桶边界：延迟（秒，50us ~ 1s）与批大小（1 ~ 256）
+    static std::vector<double> latency_buckets();
+    static std::vector<double> size_buckets();
+
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets; // 每个桶单独计数，输出时再累加
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0.0};
+};
+
+// 作用域计时：析构时把经过的秒数记入直方图
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        histogram.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+// 作用域内把 gauge 加一，离开时减一
+class ScopedIncrement {
+public:
+    explicit ScopedIncrement(Gauge& gauge) : gauge(gauge) { gauge.add(1); }
+    ~ScopedIncrement() { gauge.add(-1); }
+
+private:
+    Gauge& gauge;
+};
+
+// 输出 HELP/TYPE 头和单个样本
+void write_metric_header(std::string& out, const std::string& name, const char* type, const char* help);
+void write_metric_sample(std::string& out, const std::string& name, const std::string& labels, double value);
+
+#endif
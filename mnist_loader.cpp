@@ -1,70 +1,170 @@
 #include "mnist_loader.h"
-#include <fstream>
 #include <iostream>
 #include <cstdint>
-//从二进制文件中读取32位无符号整数。
-static uint32_t read_uint32(std::ifstream& f) {
-    uint32_t result = 0;
-    for (int i = 0; i < 4; ++i) {
-        result <<= 8;
-        result |= f.get();
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//读取大端序的32位无符号整数
+static uint32_t read_uint32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+IdxFile::~IdxFile() { close(); }
+
+IdxFile::IdxFile(IdxFile&& other) noexcept { *this = std::move(other); }
+
+IdxFile& IdxFile::operator=(IdxFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+        payload = other.payload;
+        dimensions = std::move(other.dimensions);
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+        other.payload = nullptr;
     }
-    return result;
+    return *this;
 }
-//检查并读取图像数量、行数、列数等元数据
-bool load_mnist_images(const std::string& path, std::vector<Eigen::VectorXd>& images) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error opening image file: " << path << std::endl;
+
+void IdxFile::close() {
+    if (mapping) munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+    payload = nullptr;
+    dimensions.clear();
+}
+
+bool IdxFile::open(const std::string& path, uint32_t expected_magic) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error opening file: " << path << std::endl;
         return false;
     }
-    //读取魔数（magic number）并验证是否为2051，这是MNIST图像文件的标识
-    uint32_t magic = read_uint32(file);
-    if (magic != 2051) {
-        std::cerr << "Invalid MNIST image file magic number." << std::endl;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 4) {
+        ::close(fd);
+        std::cerr << "Invalid MNIST file: " << path << std::endl;
         return false;
     }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // 映射建立后即可关闭文件描述符
+    if (map == MAP_FAILED) {
+        std::cerr << "Error mapping file: " << path << std::endl;
+        return false;
+    }
+    mapping = map;
+    mapping_size = size;
 
-    uint32_t num_images = read_uint32(file);
-    uint32_t num_rows = read_uint32(file);
-    uint32_t num_cols = read_uint32(file);
-    int size = num_rows * num_cols;
-
-    images.resize(num_images);
-
-    for (uint32_t i = 0; i < num_images; ++i) {
-        Eigen::VectorXd img(size);
-        for (int j = 0; j < size; ++j) {
-            uint8_t pixel = file.get();
-            img(j) = static_cast<double>(pixel) / 255.0;
+    //魔数的低字节为维数，高字节为数据类型（0x08 表示 uint8）
+    const uint8_t* bytes = static_cast<const uint8_t*>(map);
+    uint32_t magic = read_uint32(bytes);
+    size_t ndims = magic & 0xFF;
+    size_t header = 4 + 4 * ndims;
+    if (magic != expected_magic || size < header) {
+        std::cerr << "Invalid MNIST file magic number: " << path << std::endl;
+        close();
+        return false;
+    }
+    // 维度来自文件，逐步检查乘积是否溢出，否则回绕后的小乘积能通过下面的长度检查
+    size_t total = 1;
+    for (size_t d = 0; d < ndims; ++d) {
+        dimensions.push_back(read_uint32(bytes + 4 + 4 * d));
+        size_t dim = dimensions.back();
+        if (dim != 0 && total > SIZE_MAX / dim) {
+            std::cerr << "Invalid MNIST file dimensions: " << path << std::endl;
+            close();
+            return false;
         }
-        images[i] = img;
+        total *= dim;
     }
-
+    if (size - header < total) {
+        std::cerr << "MNIST file is truncated: " << path << std::endl;
+        close();
+        return false;
+    }
+    // 按顺序访问，提示内核预读
+    madvise(map, size, MADV_SEQUENTIAL);
+    payload = bytes + header;
     return true;
 }
 
-bool load_mnist_labels(const std::string& path, std::vector<Eigen::VectorXd>& labels, int num_classes) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error opening label file: " << path << std::endl;
+//图像文件：魔数 2051，维度为 图像数 x 行数 x 列数
+bool MnistImages::open(const std::string& path) {
+    if (!file.open(path, 2051)) return false;
+    if (file.dims().size() != 3) {
+        std::cerr << "Invalid MNIST image file: " << path << std::endl;
+        file.close();
         return false;
     }
-
-    uint32_t magic = read_uint32(file);
-    if (magic != 2049) {
-        std::cerr << "Invalid MNIST label file magic number." << std::endl;
+    uint64_t pixels = uint64_t(file.dims()[1]) * file.dims()[2];
+    if (pixels > uint64_t(INT_MAX)) {
+        std::cerr << "Invalid MNIST image size: " << file.dims()[1] << "x" << file.dims()[2] << ": " << path << std::endl;
+        file.close();
         return false;
     }
+    count = file.dims()[0];
+    num_pixels = static_cast<int>(pixels);
+    return true;
+}
 
-    uint32_t num_labels = read_uint32(file);
-    labels.resize(num_labels);
+template <typename Scalar>
+bool load_mnist_images(const std::string& path, std::vector<VectorX<Scalar>>& images) {
+    MnistImages dense;
+    if (!dense.open(path)) return false;
+    images.resize(dense.size());
+    for (size_t i = 0; i < dense.size(); ++i)
+        images[i] = dense.image(i).cast<Scalar>() / Scalar(255);
+    return true;
+}
 
-    for (uint32_t i = 0; i < num_labels; ++i) {
-        uint8_t label = file.get();
-        labels[i] = Eigen::VectorXd::Zero(num_classes);
-        labels[i](label) = 1.0;
+template <typename Scalar>
+void make_sparse_images(const MnistImages& dense, SparseImages<Scalar>& images) {
+    int size = dense.pixels();
+    images.pixels = size;
+    images.offsets.assign(1, 0);
+    images.offsets.reserve(dense.size() + 1);
+    images.indices.clear();
+    images.values.clear();
+
+    for (size_t i = 0; i < dense.size(); ++i) {
+        const uint8_t* row = dense.image(i).data();
+        for (int j = 0; j < size; ++j) {
+            if (row[j] == 0) continue;
+            images.indices.push_back(static_cast<uint16_t>(j));
+            images.values.push_back(static_cast<Scalar>(row[j]) / Scalar(255));
+        }
+        images.offsets.push_back(static_cast<uint32_t>(images.indices.size()));
     }
+}
+
+template <typename Scalar>
+bool load_mnist_images_sparse(const std::string& path, SparseImages<Scalar>& images) {
+    MnistImages dense;
+    if (!dense.open(path)) return false;
+    make_sparse_images(dense, images);
+    return true;
+}
 
+//标签文件：魔数 2049，维度为 标签数
+bool load_mnist_labels(const std::string& path, std::vector<uint8_t>& labels) {
+    IdxFile file;
+    if (!file.open(path, 2049)) return false;
+    if (file.dims().size() != 1) {
+        std::cerr << "Invalid MNIST label file: " << path << std::endl;
+        return false;
+    }
+    labels.assign(file.data(), file.data() + file.dims()[0]);
     return true;
 }
+
+template bool load_mnist_images<float>(const std::string&, std::vector<VectorX<float>>&);
+template bool load_mnist_images<double>(const std::string&, std::vector<VectorX<double>>&);
+template void make_sparse_images<float>(const MnistImages&, SparseImages<float>&);
+template void make_sparse_images<double>(const MnistImages&, SparseImages<double>&);
+template bool load_mnist_images_sparse<float>(const std::string&, SparseImages<float>&);
+template bool load_mnist_images_sparse<double>(const std::string&, SparseImages<double>&);
@@ -3,9 +3,88 @@
 
 #include <string>
 #include <vector>
-#include <Eigen/Dense>
+#include <cstdint>
+#include <cstddef>
+#include "util.h"
 
-bool load_mnist_images(const std::string& path, std::vector<Eigen::VectorXd>& images);
-bool load_mnist_labels(const std::string& path, std::vector<Eigen::VectorXd>& labels, int num_classes = 10);
+// 以 mmap 只读映射的 IDX 文件（MNIST 的图像/标签文件格式），数据区零拷贝访问
+class IdxFile {
+public:
+    IdxFile() = default;
+    ~IdxFile();
+    IdxFile(IdxFile&& other) noexcept;
+    IdxFile& operator=(IdxFile&& other) noexcept;
+    IdxFile(const IdxFile&) = delete;
+    IdxFile& operator=(const IdxFile&) = delete;
+
+    // 映射文件并检查魔数（图像 2051，标签 2049）与文件长度
+    bool open(const std::string& path, uint32_t expected_magic);
+    void close();
+
+    bool is_open() const { return payload != nullptr; }
+    const uint8_t* data() const { return payload; }                 // 数据区起点
+    const std::vector<uint32_t>& dims() const { return dimensions; } // 各维度大小
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    const uint8_t* payload = nullptr;
+    std::vector<uint32_t> dimensions;
+};
+
+// uint8 图像集：按列存储，每列一张图像（pixels x size），直接指向映射的文件内容，
+// 训练/推理时再按样本或按批转换为浮点数
+class MnistImages {
+public:
+    using ByteMatrix = Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic>;
+    using ConstMap = Eigen::Map<const ByteMatrix>;
+    using ConstImage = Eigen::Map<const Eigen::Matrix<uint8_t, Eigen::Dynamic, 1>>;
+
+    bool open(const std::string& path);
+
+    size_t size() const { return count; }
+    int pixels() const { return num_pixels; }
+    ConstMap matrix() const { return ConstMap(file.data(), num_pixels, count); }
+    ConstImage image(size_t i) const { return ConstImage(file.data() + i * num_pixels, num_pixels); }
+
+private:
+    IdxFile file;
+    size_t count = 0;
+    int num_pixels = 0;
+};
+
+// 一张图像的非零像素：indices[k] 为像素下标，values[k] 为归一化后的像素值
+template <typename Scalar>
+struct SparseImageView {
+    const uint16_t* indices;
+    const Scalar* values;
+    int nnz;
+};
+
+// 稀疏存储的图像集合（CSR）：MNIST 约 80% 的像素为 0，只保存非零像素
+template <typename Scalar>
+struct SparseImages {
+    int pixels = 0;                // 每张图像的像素总数
+    std::vector<uint32_t> offsets; // 第 i 张图像的非零像素位于 [offsets[i], offsets[i+1])
+    std::vector<uint16_t> indices;
+    std::vector<Scalar> values;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    SparseImageView<Scalar> operator[](size_t i) const {
+        return {indices.data() + offsets[i], values.data() + offsets[i],
+                static_cast<int>(offsets[i + 1] - offsets[i])};
+    }
+};
+
+// Scalar 为 float 或 double，像素归一化到 [0,1]，每张图像一个向量
+template <typename Scalar>
+bool load_mnist_images(const std::string& path, std::vector<VectorX<Scalar>>& images);
+// 只保存非零像素
+template <typename Scalar>
+void make_sparse_images(const MnistImages& dense, SparseImages<Scalar>& images);
+template <typename Scalar>
+bool load_mnist_images_sparse(const std::string& path, SparseImages<Scalar>& images);
+// 标签按类别下标连续存放（每个样本 1 字节）
+bool load_mnist_labels(const std::string& path, std::vector<uint8_t>& labels);
 
 #endif
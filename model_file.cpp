@@ -0,0 +1,203 @@
+#include "model_file.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+size_t align_up(size_t n) { return (n + kModelAlignment - 1) / kModelAlignment * kModelAlignment; }
+
+size_t dtype_size(uint32_t dtype) {
+    switch (static_cast<ModelDType>(dtype)) {
+    case ModelDType::Float32: return sizeof(float);
+    case ModelDType::Float64: return sizeof(double);
+    }
+    return 0;
+}
+
+// 整个文件的 CRC-32，文件头中的 crc32 字段按 0 计算
+uint32_t file_crc(const uint8_t* data, size_t size) {
+    ModelFileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    header.crc32 = 0;
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(&header), sizeof(header));
+    const uint8_t* p = data + sizeof(header);
+    size_t remaining = size - sizeof(header);
+    // crc32 的长度参数为 uInt，大文件分段计算
+    while (remaining > 0) {
+        uInt chunk = static_cast<uInt>(std::min<size_t>(remaining, 1u << 30));
+        crc = crc32(crc, p, chunk);
+        p += chunk;
+        remaining -= chunk;
+    }
+    return static_cast<uint32_t>(crc);
+}
+
+} // namespace
+
+ModelFile::~ModelFile() { close(); }
+
+ModelFile::ModelFile(ModelFile&& other) noexcept { *this = std::move(other); }
+
+ModelFile& ModelFile::operator=(ModelFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+        topology = std::move(other.topology);
+        tensors = std::move(other.tensors);
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+    }
+    return *this;
+}
+
+void ModelFile::close() {
+    if (mapping) munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+    topology.clear();
+    tensors.clear();
+}
+
+bool ModelFile::is_model_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kModelMagic)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, kModelMagic, sizeof(magic)) == 0;
+}
+
+bool ModelFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "无法打开模型文件: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ModelFileHeader)) {
+        ::close(fd);
+        std::cerr << "模型文件过短: " << path << std::endl;
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "无法映射模型文件: " << path << std::endl;
+        return false;
+    }
+    mapping = map;
+    mapping_size = size;
+
+    auto fail = [&](const char* reason) {
+        std::cerr << "模型文件无效（" << reason << "）: " << path << std::endl;
+        close();
+        return false;
+    };
+    const uint8_t* bytes = static_cast<const uint8_t*>(map);
+    const ModelFileHeader& h = header();
+    if (std::memcmp(h.magic, kModelMagic, sizeof(kModelMagic)) != 0) return fail("魔数不符");
+    if (h.version != kModelVersion) return fail("不支持的版本");
+    size_t element_size = dtype_size(h.dtype);
+    if (element_size == 0) return fail("未知的数据类型");
+    if (h.file_size != size) return fail("文件长度与文件头不符，可能被截断");
+    size_t table_end = sizeof(ModelFileHeader) + size_t(h.num_layers) * sizeof(uint32_t) +
+                       size_t(h.num_tensors) * sizeof(ModelTensorEntry);
+    if (h.num_layers > 1024 || h.num_tensors > 1024 || table_end > size) return fail("张量表越界");
+    if (file_crc(bytes, size) != h.crc32) return fail("CRC 校验失败");
+
+    topology.resize(h.num_layers);
+    std::memcpy(topology.data(), bytes + sizeof(ModelFileHeader), topology.size() * sizeof(uint32_t));
+    tensors.resize(h.num_tensors);
+    std::memcpy(tensors.data(), bytes + sizeof(ModelFileHeader) + topology.size() * sizeof(uint32_t),
+                tensors.size() * sizeof(ModelTensorEntry));
+    for (const ModelTensorEntry& t : tensors) {
+        // rows * cols * element_size 可能溢出，先检查尺寸非零，再用除法与剩余长度比较
+        if (t.rows == 0 || t.cols == 0) return fail("张量尺寸为 0");
+        if (t.offset % kModelAlignment != 0 || t.offset < table_end || t.offset > size ||
+            t.cols > (size - t.offset) / element_size / t.rows)
+            return fail("张量位置无效");
+    }
+    // 加载时会顺序读取全部张量，提示内核预读
+    madvise(map, size, MADV_WILLNEED);
+    return true;
+}
+
+template <typename Scalar>
+MatrixX<Scalar> ModelFile::read_tensor(size_t i) const {
+    const uint8_t* data = static_cast<const uint8_t*>(mapping) + tensors[i].offset;
+    if (dtype() == ModelDType::Float64)
+        return Eigen::Map<const MatrixX<double>>(reinterpret_cast<const double*>(data), tensors[i].rows,
+                                                 tensors[i].cols).cast<Scalar>();
+    return Eigen::Map<const MatrixX<float>>(reinterpret_cast<const float*>(data), tensors[i].rows,
+                                            tensors[i].cols).cast<Scalar>();
+}
+
+template <typename Scalar>
+bool write_model_file(const std::string& path, const std::vector<uint32_t>& layers,
+                      const std::vector<ModelTensor<Scalar>>& tensors) {
+    ModelFileHeader header{};
+    std::memcpy(header.magic, kModelMagic, sizeof(kModelMagic));
+    header.version = kModelVersion;
+    header.dtype = static_cast<uint32_t>(model_dtype<Scalar>());
+    header.num_layers = static_cast<uint32_t>(layers.size());
+    header.num_tensors = static_cast<uint32_t>(tensors.size());
+
+    // 先确定各张量的偏移，再把整个文件组装在内存中计算 CRC
+    std::vector<ModelTensorEntry> entries(tensors.size());
+    size_t offset = align_up(sizeof(ModelFileHeader) + layers.size() * sizeof(uint32_t) +
+                             tensors.size() * sizeof(ModelTensorEntry));
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        entries[i] = ModelTensorEntry{tensors[i].rows, tensors[i].cols, offset};
+        offset = align_up(offset + size_t(tensors[i].rows) * tensors[i].cols * sizeof(Scalar));
+    }
+    header.file_size = offset;
+
+    std::vector<uint8_t> file(offset, 0);
+    uint8_t* p = file.data() + sizeof(ModelFileHeader);
+    std::memcpy(p, layers.data(), layers.size() * sizeof(uint32_t));
+    p += layers.size() * sizeof(uint32_t);
+    std::memcpy(p, entries.data(), entries.size() * sizeof(ModelTensorEntry));
+    for (size_t i = 0; i < tensors.size(); ++i)
+        std::memcpy(file.data() + entries[i].offset, tensors[i].data,
+                    size_t(tensors[i].rows) * tensors[i].cols * sizeof(Scalar));
+    std::memcpy(file.data(), &header, sizeof(header));
+    header.crc32 = file_crc(file.data(), file.size());
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "无法打开文件保存参数: " << temp_path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!out.flush()) {
+            std::cerr << "写入参数文件失败: " << temp_path << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "无法替换参数文件: " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+template bool write_model_file<float>(const std::string&, const std::vector<uint32_t>&,
+                                      const std::vector<ModelTensor<float>>&);
+template bool write_model_file<double>(const std::string&, const std::vector<uint32_t>&,
+                                       const std::vector<ModelTensor<double>>&);
+
+template MatrixX<float> ModelFile::read_tensor<float>(size_t) const;
+template MatrixX<double> ModelFile::read_tensor<double>(size_t) const;
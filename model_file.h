@@ -0,0 +1,100 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include "util.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 模型参数文件格式（小端，版本 1）：
+//   [0, 64)        文件头 ModelFileHeader
+//   [64, ...)      拓扑：num_layers 个 uint32（各层神经元数，例如 784 128 10）
+//                  张量表：num_tensors 个 ModelTensorEntry
+//   之后           各张量数据，按列存储，每个张量起点 64 字节对齐，中间以 0 填充
+// crc32 为整个文件（crc32 字段按 0 计算）的 CRC-32，加载时校验，可发现截断或损坏的文件。
+// 各网络加载时都要把参数转换为自己的类型与布局（double/float、补齐的定长数组、int8 量化、扁平数组），
+// 所以读取方从映射中复制张量，加载完成后即解除映射
+
+enum class ModelDType : uint32_t {
+    Float32 = 1,
+    Float64 = 2,
+};
+
+template <typename Scalar>
+constexpr ModelDType model_dtype() {
+    return std::is_same<Scalar, double>::value ? ModelDType::Float64 : ModelDType::Float32;
+}
+
+const char kModelMagic[8] = {'N', 'R', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t kModelVersion = 1;
+const size_t kModelAlignment = 64;
+
+struct ModelFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;       // ModelDType
+    uint32_t num_layers;
+    uint32_t num_tensors;
+    uint64_t file_size;
+    uint32_t crc32;
+    uint32_t reserved[7];
+};
+static_assert(sizeof(ModelFileHeader) == 64, "模型文件头应为 64 字节");
+
+struct ModelTensorEntry {
+    uint32_t rows, cols;
+    uint64_t offset; // 相对文件起点，kModelAlignment 的整数倍
+};
+static_assert(sizeof(ModelTensorEntry) == 16, "张量表项应为 16 字节");
+
+// 写入时的一个张量：按列存储的 rows x cols 矩阵（向量为 cols = 1）
+template <typename Scalar>
+struct ModelTensor {
+    const Scalar* data;
+    uint32_t rows, cols;
+};
+
+// 只读映射的模型文件，打开时检查魔数、版本、各张量的范围与对齐以及 CRC
+class ModelFile {
+public:
+    ModelFile() = default;
+    ~ModelFile();
+    ModelFile(ModelFile&& other) noexcept;
+    ModelFile& operator=(ModelFile&& other) noexcept;
+    ModelFile(const ModelFile&) = delete;
+    ModelFile& operator=(const ModelFile&) = delete;
+
+    // 文件开头是否为本格式的魔数（用于与旧格式区分，不做其它检查）
+    static bool is_model_file(const std::string& path);
+
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return mapping != nullptr; }
+    ModelDType dtype() const { return static_cast<ModelDType>(header().dtype); }
+    const std::vector<uint32_t>& layers() const { return topology; }
+    size_t num_tensors() const { return tensors.size(); }
+    uint32_t rows(size_t i) const { return tensors[i].rows; }
+    uint32_t cols(size_t i) const { return tensors[i].cols; }
+
+    // 复制第 i 个张量（rows(i) x cols(i)），并从文件中的 dtype() 转换为 Scalar
+    template <typename Scalar>
+    MatrixX<Scalar> read_tensor(size_t i) const;
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    std::vector<uint32_t> topology;
+    std::vector<ModelTensorEntry> tensors;
+
+    const ModelFileHeader& header() const { return *static_cast<const ModelFileHeader*>(mapping); }
+};
+
+// 按上述格式写出模型文件：先写入同目录下的临时文件再重命名，读取方不会看到写了一半的文件
+template <typename Scalar>
+bool write_model_file(const std::string& path, const std::vector<uint32_t>& layers,
+                      const std::vector<ModelTensor<Scalar>>& tensors);
+
+#endif
@@ -0,0 +1,115 @@
+#include "model_store.h"
+#include "logger.h"
+#include <exception>
+#include <utility>
+#include <sys/stat.h>
+
+namespace {
+
+std::atomic<uint64_t> next_store_id{1};
+
+// 每个线程最近一次从 store_id 取得的模型。只保存 weak_ptr，不会让已替换的模型多活
+struct CachedSnapshot {
+    uint64_t store_id = 0;
+    uint64_t generation = 0;
+    std::weak_ptr<const NeuralNetwork> model;
+};
+
+} // namespace
+
+ModelStore::ModelStore(Snapshot initial)
+    : id(next_store_id.fetch_add(1, std::memory_order_relaxed)), model(std::move(initial)) {}
+
+ModelStore::Snapshot ModelStore::current() const {
+    static thread_local CachedSnapshot cache;
+    if (cache.store_id == id && cache.generation == generation_count.load(std::memory_order_acquire)) {
+        // store 一直持有当前模型，序号未变时 lock() 必定成功（引用计数的原子比较交换，不加锁）；
+        // 与 publish 并发时可能取到刚被替换的模型，与发布前一刻读取的结果相同
+        if (Snapshot snapshot = cache.model.lock()) return snapshot;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.store_id = id;
+    cache.generation = generation_count.load(std::memory_order_relaxed);
+    cache.model = model;
+    return model;
+}
+
+void ModelStore::publish(Snapshot next) {
+    Snapshot previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        previous = std::exchange(model, std::move(next));
+        generation_count.fetch_add(1, std::memory_order_release);
+    }
+    // 没有其他快照时旧模型在锁外析构
+}
+
+ModelReloader::ModelReloader(ModelStore& store, std::string path, std::chrono::milliseconds poll_interval,
+                             Callback on_reload)
+    : store(store), path(std::move(path)), poll_interval(poll_interval), on_reload(std::move(on_reload))
+{
+    stat_file(last_seen); // 当前文件即已加载的模型，只有之后的修改才触发重载
+    if (poll_interval.count() > 0) watcher = std::thread(&ModelReloader::watch_loop, this);
+}
+
+ModelReloader::~ModelReloader() {
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (watcher.joinable()) watcher.join();
+}
+
+bool ModelReloader::stat_file(FileStamp& stamp) const {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.inode = static_cast<uint64_t>(st.st_ino);
+    stamp.mtime = static_cast<int64_t>(st.st_mtime);
+    stamp.size = static_cast<int64_t>(st.st_size);
+    return true;
+}
+
+bool ModelReloader::reload() {
+    std::lock_guard<std::mutex> lock(reload_mutex);
+    stat_file(last_seen);
+    // 加载在调用线程中完成，推理线程继续使用当前模型。监视线程中抛出的异常会终止进程，
+    // 因此加载时的任何异常（例如按损坏的尺寸分配内存失败）都视为加载失败
+    std::unique_ptr<NeuralNetwork> next;
+    try {
+        next = NeuralNetwork::from_file(path);
+    } catch (const std::exception& e) {
+        LOG_ERROR("加载模型时出错: " << e.what() << ": " << path);
+    }
+    ModelStore::Snapshot current = store.current();
+    bool ok = next != nullptr;
+    if (!ok) {
+        LOG_WARN("模型重新加载失败，继续使用当前模型: " << path);
+    } else if (next->num_inputs() != current->num_inputs() || next->num_outputs() != current->num_outputs()) {
+        LOG_WARN("新模型的输入/输出维度 " << next->num_inputs() << "/" << next->num_outputs() << " 与当前模型 "
+                 << current->num_inputs() << "/" << current->num_outputs() << " 不符，忽略: " << path);
+        ok = false;
+    } else {
+        store.publish(std::move(next));
+        LOG_INFO("已发布新模型 #" << store.generation() << ": " << path);
+    }
+    if (on_reload) on_reload(ok);
+    return ok;
+}
+
+void ModelReloader::watch_loop() {
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    while (!cv.wait_for(lock, poll_interval, [this] { return stopping; })) {
+        lock.unlock();
+        FileStamp stamp;
+        bool changed;
+        {
+            std::lock_guard<std::mutex> guard(reload_mutex);
+            changed = stat_file(stamp) && !(stamp == last_seen);
+        }
+        // 保存时先写临时文件再重命名，这里看到的总是完整的文件；
+        // 直接覆盖写入时可能读到一半，CRC 校验失败后等下一次修改再试
+        if (changed) reload();
+        lock.lock();
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+#include "neural_net.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 服务当前使用的模型（RCU 风格）：读取方用 current() 取得 shared_ptr 快照，整批推理都用这一份参数；
+// publish 换上新模型，正在使用旧模型的请求照常完成，旧模型在最后一个快照释放时析构。
+// 读取路径不加锁：每个线程缓存最近取得的模型（weak_ptr）及其序号，序号未变时只需一次原子读和
+// 一次引用计数增加；每次发布后各线程的第一次读取才在互斥锁下取新模型。
+// 不用 std::atomic_load(shared_ptr)：libstdc++ 用全局的互斥锁池实现它，每次读取都要加锁
+class ModelStore {
+public:
+    using Snapshot = std::shared_ptr<const NeuralNetwork>;
+
+    explicit ModelStore(Snapshot initial);
+
+    Snapshot current() const;
+    void publish(Snapshot next);
+    // 已发布的模型序号，初始模型为 1
+    uint64_t generation() const { return generation_count.load(std::memory_order_acquire); }
+
+private:
+    const uint64_t id; // 进程内唯一，区分各线程缓存的是哪个 store 的模型
+    mutable std::mutex mutex; // 保护 model，并保证 model 与 generation_count 一同更新
+    Snapshot model;
+    std::atomic<uint64_t> generation_count{1};
+};
+
+// 模型热更新：后台线程每隔 poll_interval 检查一次参数文件的 inode、修改时间与长度，变化后在后台加载
+// （from_file，含 CRC 校验）并发布到 store；也可直接调用 reload()（例如管理接口）。
+// 新模型的输入/输出维度必须与当前模型一致，加载失败时继续使用当前模型
+class ModelReloader {
+public:
+    // 每次尝试重载后调用，ok 表示是否已发布新模型
+    using Callback = std::function<void(bool ok)>;
+
+    // poll_interval 为 0 时不启动监视线程，只能手动 reload()
+    ModelReloader(ModelStore& store, std::string path, std::chrono::milliseconds poll_interval,
+                  Callback on_reload = Callback());
+    ~ModelReloader();
+
+    ModelReloader(const ModelReloader&) = delete;
+    ModelReloader& operator=(const ModelReloader&) = delete;
+
+    // 立即从文件重新加载并发布，多个调用方串行执行；返回是否成功
+    bool reload();
+
+private:
+    // 文件状态：保存模型时以重命名替换文件，inode 必然变化，即使修改时间的精度只有 1 秒也能发现
+    struct FileStamp {
+        uint64_t inode = 0;
+        int64_t mtime = 0;
+        int64_t size = 0;
+        bool operator==(const FileStamp& other) const {
+            return inode == other.inode && mtime == other.mtime && size == other.size;
+        }
+    };
+
+    bool stat_file(FileStamp& stamp) const;
+    void watch_loop();
+
+    ModelStore& store;
+    std::string path;
+    std::chrono::milliseconds poll_interval;
+    Callback on_reload;
+
+    std::mutex reload_mutex;
+    FileStamp last_seen; // 最近一次尝试加载时的文件状态（由 reload_mutex 保护）
+
+    std::mutex wait_mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread watcher;
+};
+
+#endif
@@ -1,88 +1,311 @@
 #include "neural_net.h"
 #include "util.h"
+#include "thread_pool.h"
+#include "model_file.h"
 #include <random>
 #include <iostream> 
 #include <iomanip> // for output formatting
 #include <fstream>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
 
-NeuralNetwork::NeuralNetwork(int input_size, int hidden_size, int output_size)
+namespace {
+
+template <typename Inputs, typename Scalar>
+constexpr bool is_sparse_inputs() { return std::is_same<Inputs, SparseImages<Scalar>>::value; }
+
+// 取第 i 个样本：稠密向量与稀疏视图直接返回，uint8 图像在这里才转换为浮点数，写入 buffer
+template <typename Scalar>
+const VectorX<Scalar>& sample_at(const std::vector<VectorX<Scalar>>& X, int i, VectorX<Scalar>&) {
+    return X[i];
+}
+template <typename Scalar>
+SparseImageView<Scalar> sample_at(const SparseImages<Scalar>& X, int i, VectorX<Scalar>&) {
+    return X[i];
+}
+template <typename Scalar>
+const VectorX<Scalar>& sample_at(const MnistImages& X, int i, VectorX<Scalar>& buffer) {
+    buffer = X.image(i).cast<Scalar>() * Scalar(1.0 / 255);
+    return buffer;
+}
+
+// 每个样本的维度是否都等于网络的输入维度（IDX 文件中的图像尺寸来自文件头，不一定是 28x28）
+template <typename Scalar>
+bool inputs_match(const std::vector<VectorX<Scalar>>& X, int input_size) {
+    return std::all_of(X.begin(), X.end(), [&](const VectorX<Scalar>& x) { return x.size() == input_size; });
+}
+template <typename Scalar>
+bool inputs_match(const SparseImages<Scalar>& X, int input_size) {
+    return X.size() == 0 || X.pixels == input_size;
+}
+inline bool inputs_match(const MnistImages& X, int input_size) {
+    return X.size() == 0 || X.pixels() == input_size;
+}
+
+// 把样本 [begin, begin + X.cols()) 按列拼进 X（uint8 图像整块转换一次）
+template <typename Scalar, typename Dest>
+void gather_columns(const std::vector<VectorX<Scalar>>& images, int begin, Dest&& X) {
+    for (int j = 0; j < X.cols(); ++j)
+        X.col(j) = images[begin + j];
+}
+template <typename Dest>
+void gather_columns(const MnistImages& images, int begin, Dest&& X) {
+    using Scalar = typename std::decay_t<Dest>::Scalar;
+    X = images.matrix().middleCols(begin, X.cols()).template cast<Scalar>() * Scalar(1.0 / 255);
+}
+
+// 第一层：out = W * x。稠密输入直接做矩阵乘向量，
+// 稀疏输入只累加非零像素对应的那几列（W 按列存储，每列连续）
+template <typename Scalar, typename Dest>
+void input_product(const MatrixX<Scalar>& W, const VectorX<Scalar>& x, Dest&& out) {
+    out.noalias() = W * x;
+}
+template <typename Scalar, typename Dest>
+void input_product(const MatrixX<Scalar>& W, const SparseImageView<Scalar>& x, Dest&& out) {
+    out.setZero();
+    for (int k = 0; k < x.nnz; ++k)
+        out += x.values[k] * W.col(x.indices[k]);
+}
+
+// 第一层的秩 1 更新：W -= alpha * d * x^T。稀疏输入只改动非零像素对应的列
+template <typename Scalar, typename Derived>
+void subtract_outer(MatrixX<Scalar>& W, const Eigen::MatrixBase<Derived>& d,
+                    const VectorX<Scalar>& x, Scalar alpha = Scalar(1)) {
+    if (alpha == Scalar(1)) W.noalias() -= d * x.transpose();
+    else W.noalias() -= alpha * d * x.transpose();
+}
+template <typename Scalar, typename Derived>
+void subtract_outer(MatrixX<Scalar>& W, const Eigen::MatrixBase<Derived>& d,
+                    const SparseImageView<Scalar>& x, Scalar alpha = Scalar(1)) {
+    for (int k = 0; k < x.nnz; ++k)
+        W.col(x.indices[k]) -= (alpha * x.values[k]) * d;
+}
+
+// 推理用的临时矩阵，每个线程一份。列数只增不减（按需扩容），
+// 稳定后推理不再申请堆内存，实际只使用前 n 列
+template <typename Scalar>
+struct InferenceScratch {
+    MatrixX<Scalar> X, A1, A2;
+};
+
+template <typename Scalar>
+InferenceScratch<Scalar>& inference_scratch() {
+    static thread_local InferenceScratch<Scalar> scratch;
+    return scratch;
+}
+
+template <typename Scalar>
+void ensure_capacity(MatrixX<Scalar>& m, Eigen::Index rows, Eigen::Index cols) {
+    if (m.rows() != rows || m.cols() < cols) m.resize(rows, std::max(cols, m.cols()));
+}
+
+} // namespace
+
+template <typename Scalar>
+BasicNeuralNetwork<Scalar>::BasicNeuralNetwork(int input_size, int hidden_size, int output_size)
     : input_size(input_size), hidden_size(hidden_size), output_size(output_size)
 {
     // 初始化权重与偏置（使用正态分布）
     std::random_device rd; // 随机数生成器
     std::mt19937 gen(rd()); // 使用随机数种子
-    std::normal_distribution<> dist(0, 1.0); // 正态分布，均值0，标准差1
+    std::normal_distribution<double> dist(0, 1.0); // 正态分布，均值0，标准差1
 
-    W1 = Eigen::MatrixXd(hidden_size, input_size); // hidden_size 行 input_size 列
-    b1 = Eigen::VectorXd::Zero(hidden_size); //列向量，大小为 hidden_size
-    W2 = Eigen::MatrixXd(output_size, hidden_size);
-    b2 = Eigen::VectorXd::Zero(output_size);
+    W1 = Matrix(hidden_size, input_size); // hidden_size 行 input_size 列
+    b1 = Vector::Zero(hidden_size); //列向量，大小为 hidden_size
+    W2 = Matrix(output_size, hidden_size);
+    b2 = Vector::Zero(output_size);
     // Xavier 初始化
 
     for (int i = 0; i < hidden_size; ++i)
         for (int j = 0; j < input_size; ++j)
-            W1(i, j) = dist(gen) * std::sqrt(1.0 / input_size); 
+            W1(i, j) = static_cast<Scalar>(dist(gen) * std::sqrt(1.0 / input_size));
 
     for (int i = 0; i < output_size; ++i)
         for (int j = 0; j < hidden_size; ++j)
-            W2(i, j) = dist(gen) * std::sqrt(1.0 / hidden_size);
+            W2(i, j) = static_cast<Scalar>(dist(gen) * std::sqrt(1.0 / hidden_size));
 }
-//向前传播
-Eigen::VectorXd NeuralNetwork::forward(const Eigen::VectorXd& input) {
-    // input: [784]
-    Eigen::VectorXd Z1 = W1 * input + b1;      // [hidden_size]
-    Eigen::VectorXd A1 = sigmoid(Z1);          // 激活
-    Eigen::VectorXd Z2 = W2 * A1 + b2;         // [output_size]
-    Eigen::VectorXd A2 = softmax(Z2);          // softmax 输出概率
+
+template <typename Scalar>
+std::unique_ptr<BasicNeuralNetwork<Scalar>> BasicNeuralNetwork<Scalar>::from_file(const std::string& filename) {
+    std::unique_ptr<BasicNeuralNetwork> net(new BasicNeuralNetwork());
+    if (!net->load_parameters(filename)) return nullptr;
+    return net;
+}
+
+template <typename Scalar>
+Eigen::Block<typename BasicNeuralNetwork<Scalar>::Matrix, Eigen::Dynamic, Eigen::Dynamic, true>
+BasicNeuralNetwork<Scalar>::forward_scratch(const Eigen::Ref<const Matrix>& inputs) const {
+    InferenceScratch<Scalar>& scratch = inference_scratch<Scalar>();
+    Eigen::Index n = inputs.cols();
+    ensure_capacity(scratch.A1, hidden_size, n);
+    ensure_capacity(scratch.A2, output_size, n);
+    auto A1 = scratch.A1.leftCols(n);
+    A1.noalias() = W1 * inputs;       // [hidden_size x N]
+    A1.colwise() += b1;
+    sigmoid_inplace<Scalar>(A1);
+    auto A2 = scratch.A2.leftCols(n);
+    A2.noalias() = W2 * A1;           // [output_size x N]
+    A2.colwise() += b2;
+    softmax_columns_inplace<Scalar>(A2);
     return A2;
 }
+
+//向前传播
+template <typename Scalar>
+typename BasicNeuralNetwork<Scalar>::Vector BasicNeuralNetwork<Scalar>::forward(const Vector& input) const {
+    // input: [784]，输出 softmax 概率 [output_size]
+    return forward_scratch(input).col(0);
+}
 //获得预测值
-int NeuralNetwork::predict(const Eigen::VectorXd& input) {
-    Eigen::VectorXd output = forward(input);
-    return argmax(output);
+template <typename Scalar>
+int BasicNeuralNetwork<Scalar>::predict(const Vector& input) const {
+    return argmax(forward_scratch(input).col(0));
+}
+
+template <typename Scalar>
+typename BasicNeuralNetwork<Scalar>::Matrix
+BasicNeuralNetwork<Scalar>::forward_batch(const Eigen::Ref<const Matrix>& inputs) const {
+    return forward_scratch(inputs);
+}
+
+template <typename Scalar>
+std::vector<int> BasicNeuralNetwork<Scalar>::predict_batch(const Eigen::Ref<const Matrix>& inputs,
+                                                           Matrix* probabilities) const {
+    auto A2 = forward_scratch(inputs);
+    std::vector<int> labels(A2.cols());
+    for (Eigen::Index j = 0; j < A2.cols(); ++j)
+        labels[j] = argmax(A2.col(j));
+    if (probabilities) *probabilities = A2;
+    return labels;
+}
+
+template <typename Scalar>
+std::vector<int> BasicNeuralNetwork<Scalar>::predict_batch(const uint8_t* pixels, size_t count,
+                                                           Matrix* probabilities) const {
+    // 每块 1024 张图像：转换后的浮点矩阵约 3 MB，整块做一次 GEMM
+    const size_t chunk = 1024;
+    std::vector<int> labels(count);
+    if (probabilities) probabilities->resize(output_size, count);
+    MatrixX<Scalar>& X = inference_scratch<Scalar>().X;
+    ensure_capacity(X, input_size, static_cast<Eigen::Index>(std::min(chunk, count)));
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        Eigen::Index n = static_cast<Eigen::Index>(std::min(chunk, count - begin));
+        Eigen::Map<const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic>> bytes(
+            pixels + begin * input_size, input_size, n);
+        X.leftCols(n) = bytes.cast<Scalar>() * Scalar(1.0 / 255);
+        auto A2 = forward_scratch(X.leftCols(n));
+        for (Eigen::Index j = 0; j < n; ++j)
+            labels[begin + j] = argmax(A2.col(j));
+        if (probabilities) probabilities->middleCols(begin, n) = A2;
+    }
+    return labels;
 }
+
+template <typename Scalar>
+std::vector<int> BasicNeuralNetwork<Scalar>::predict_batch(const MnistImages& images, Matrix* probabilities) const {
+    if (!inputs_match(images, input_size)) {
+        std::cerr << "图像的像素数 " << images.pixels() << " 与网络输入维度 " << input_size << " 不符" << std::endl;
+        return {};
+    }
+    return predict_batch(images.matrix().data(), images.size(), probabilities);
+}
+
 //X_train: 输入数据，其中每一列代表一个样本的784个像素点；y_train: 标签数据 
 // epochs: 训练轮数，learning_rate: 学习率
-void NeuralNetwork::train(const std::vector<Eigen::VectorXd>& X_train,
-                          const std::vector<Eigen::VectorXd>& y_train,
-                          int epochs, double learning_rate) {
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::train(const std::vector<Vector>& X_train,
+                                       const std::vector<uint8_t>& y_train,
+                                       int epochs, double learning_rate) {
+    TrainOptions options;
+    options.epochs = epochs;
+    options.learning_rate = learning_rate;
+    train(X_train, y_train, options);
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::train(const std::vector<Vector>& X_train,
+                                       const std::vector<uint8_t>& y_train,
+                                       const TrainOptions& options) {
+    train_impl(X_train, y_train, options);
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::train(const SparseImages<Scalar>& X_train,
+                                       const std::vector<uint8_t>& y_train,
+                                       const TrainOptions& options) {
+    train_impl(X_train, y_train, options);
+}
+
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::train(const MnistImages& X_train,
+                                       const std::vector<uint8_t>& y_train,
+                                       const TrainOptions& options) {
+    train_impl(X_train, y_train, options);
+}
+
+template <typename Scalar>
+template <typename Inputs>
+void BasicNeuralNetwork<Scalar>::train_impl(const Inputs& X_train,
+                                            const std::vector<uint8_t>& y_train,
+                                            const TrainOptions& options) {
     int n_samples = X_train.size();
+    if (y_train.size() != X_train.size()) {
+        std::cerr << "图像数与标签数不一致: " << X_train.size() << " vs " << y_train.size() << std::endl;
+        return;
+    }
+    if (!inputs_match(X_train, input_size)) {
+        std::cerr << "训练图像的像素数与网络输入维度 " << input_size << " 不符" << std::endl;
+        return;
+    }
+    for (uint8_t label : y_train) {
+        if (label >= output_size) {
+            std::cerr << "标签超出输出层范围: " << int(label) << std::endl;
+            return;
+        }
+    }
+    Scalar learning_rate = static_cast<Scalar>(options.learning_rate);
+    int batch_size = std::max(1, options.batch_size);
+    int num_threads = std::max(1, options.num_threads);
+    if (num_threads > 1 && batch_size == 1 && !options.hogwild) {
+        std::cerr << "多线程数据并行需要 batch_size > 1，将使用单线程训练" << std::endl;
+        num_threads = 1;
+    }
+    std::unique_ptr<ThreadPool> pool;
+    if (num_threads > 1) pool.reset(new ThreadPool(num_threads));
+    bool per_sample = batch_size == 1 || (options.hogwild && pool);
+    // 每个线程一份工作区，训练开始前一次性分配好，之后每一步复用
+    int batch_capacity = per_sample ? 0 : (batch_size + num_threads - 1) / num_threads;
+    workspaces.resize(num_threads);
+    for (auto& ws : workspaces)
+        ws.reserve(input_size, hidden_size, output_size, batch_capacity, !per_sample && pool);
 //重复训练
-    for (int epoch = 0; epoch < epochs; ++epoch) {
+    for (int epoch = 0; epoch < options.epochs; ++epoch) {
         double total_loss = 0.0;
         int correct = 0; // 记录正确预测的数量
-        // 遍历每个样本
-        // X_train[i]: 表示第i个样本，是一个列向量；y_train[i]: 标签数据
-        for (int i = 0; i < n_samples; ++i) {
-            const Eigen::VectorXd& x = X_train[i];
-            const Eigen::VectorXd& y = y_train[i]; // one-hot标签
-
-            // 向前传播
-            Eigen::VectorXd Z1 = W1 * x + b1;
-            Eigen::VectorXd A1 = sigmoid(Z1);
-            Eigen::VectorXd Z2 = W2 * A1 + b2;
-            Eigen::VectorXd A2 = softmax(Z2);
-
-            // 损失函数
-            total_loss += cross_entropy_loss(A2, y);
-            //如果预测正确，即 A2 的最大值索引与 y 的最大值索引相同，则正确计数加1
-            if (argmax(A2) == argmax(y)) correct++;
-
-            // 反向传播
-            Eigen::VectorXd dZ2 = A2 - y; // 输出层误差
-            Eigen::MatrixXd dW2 = dZ2 * A1.transpose(); //对W2的梯度
-            Eigen::VectorXd db2 = dZ2; //对b2的梯度
-
-            Eigen::VectorXd dA1 = W2.transpose() * dZ2;
-            Eigen::VectorXd dZ1 = dA1.array() * sigmoid_derivative(Z1).array(); // elementwise
-            Eigen::MatrixXd dW1 = dZ1 * x.transpose();
-            Eigen::VectorXd db1 = dZ1;
-
-            // 梯度下降
-            W2 -= learning_rate * dW2;
-            b2 -= learning_rate * db2;
-            W1 -= learning_rate * dW1;
-            b1 -= learning_rate * db1;
+        if (per_sample) {
+            if (pool) {
+                total_loss += train_epoch_hogwild(X_train, y_train, learning_rate, correct, *pool);
+            } else {
+                // 遍历每个样本
+                // X_train[i]: 表示第i个样本，是一个列向量；y_train[i]: 标签数据
+                Workspace& ws = workspaces[0];
+                ws.loss = 0.0;
+                ws.correct = 0;
+                for (int i = 0; i < n_samples; ++i)
+                    train_sample(sample_at(X_train, i, ws.x), y_train[i], learning_rate, ws);
+                total_loss += ws.loss;
+                correct += ws.correct;
+            }
+        } else {
+            // 小批量：每次取 batch_size 个样本拼成矩阵
+            for (int begin = 0; begin < n_samples; begin += batch_size) {
+                int end = std::min(n_samples, begin + batch_size);
+                total_loss += train_batch(X_train, y_train, begin, end, learning_rate,
+                                          correct, pool.get());
+            }
         }
 
         // 每个 epoch 打印损失和准确率
@@ -92,60 +315,319 @@ void NeuralNetwork::train(const std::vector<Eigen::VectorXd>& X_train,
     }
 }
 
-void NeuralNetwork::save_parameters(const std::string& filename) const {
-    std::ofstream out(filename, std::ios::binary);
-    if (!out.is_open()) {
-        std::cerr << "无法打开文件保存参数: " << filename << std::endl;
-        return;
+template <typename Scalar>
+void BasicNeuralNetwork<Scalar>::Workspace::reserve(int input_size, int hidden_size, int output_size,
+                                                    int batch_capacity, bool data_parallel) {
+    x.resize(input_size);
+    a1.resize(hidden_size);
+    dz1.resize(hidden_size);
+    a2.resize(output_size);
+    // 只有数据并行需要单独的梯度矩阵，其余路径把更新直接融合进权重
+    int grad_rows = data_parallel ? hidden_size : 0;
+    dW1.resize(grad_rows, data_parallel ? input_size : 0);
+    db1.resize(grad_rows);
+    dW2.resize(data_parallel ? output_size : 0, grad_rows);
+    db2.resize(data_parallel ? output_size : 0);
+    X.resize(input_size, batch_capacity);
+    A1.resize(hidden_size, batch_capacity);
+    dA1.resize(hidden_size, batch_capacity);
+    A2.resize(output_size, batch_capacity);
+}
+
+template <typename Scalar>
+template <typename Input>
+void BasicNeuralNetwork<Scalar>::train_sample(const Input& x, int label,
+                                              Scalar learning_rate, Workspace& ws) {
+    // 向前传播，结果直接写入工作区
+    input_product(W1, x, ws.a1);
+    ws.a1 += b1;
+    sigmoid_inplace<Scalar>(ws.a1);
+    ws.a2.noalias() = W2 * ws.a1;
+    ws.a2 += b2;
+    softmax_columns_inplace<Scalar>(ws.a2);
+
+    // 损失函数
+    ws.loss += cross_entropy_loss(ws.a2, label);
+    //如果预测正确，即 A2 的最大值索引等于标签，则正确计数加1
+    if (argmax(ws.a2) == label) ws.correct++;
+
+    // 反向传播：输出层误差 A2 - onehot(label) 原地覆盖 A2，并预先乘上学习率，
+    // 之后由它推出的 dz1 与各梯度都已包含学习率
+    Vector& dz2 = ws.a2;
+    dz2(label) -= Scalar(1);
+    dz2 *= learning_rate;
+
+    ws.dz1.noalias() = W2.transpose() * dz2;
+    multiply_sigmoid_derivative<Scalar>(ws.dz1, ws.a1); // sigmoid 导数 A1 * (1 - A1)
+
+    // 梯度下降：秩 1 更新直接减到权重上，不再生成 dW1/dW2 矩阵，
+    // 最大的 W1 每个样本只读写一遍（稀疏输入时只写非零像素对应的列）
+    W2.noalias() -= dz2 * ws.a1.transpose();
+    b2 -= dz2;
+    subtract_outer(W1, ws.dz1, x);
+    b1 -= ws.dz1;
+}
+
+// Hogwild：各线程负责连续的一段样本，逐样本更新共享参数，不加任何锁。
+// 线程间对同一权重的读写会相互覆盖，这正是 Hogwild 接受的代价：MNIST 输入稀疏，
+// 冲突的更新很少，收敛性基本不受影响，但换来了无同步的线性扩展。
+template <typename Scalar>
+template <typename Inputs>
+double BasicNeuralNetwork<Scalar>::train_epoch_hogwild(const Inputs& X_train,
+                                                       const std::vector<uint8_t>& y_train,
+                                                       Scalar learning_rate, int& correct, ThreadPool& pool) {
+    int n_samples = X_train.size();
+    int parts = pool.size();
+    int chunk = (n_samples + parts - 1) / parts;
+    pool.run([&](int t) {
+        Workspace& ws = workspaces[t];
+        ws.loss = 0.0;
+        ws.correct = 0;
+        int lo = std::min(n_samples, t * chunk);
+        int hi = std::min(n_samples, lo + chunk);
+        for (int i = lo; i < hi; ++i)
+            train_sample(sample_at(X_train, i, ws.x), y_train[i], learning_rate, ws);
+    });
+    double loss = 0.0;
+    for (int t = 0; t < parts; ++t) {
+        loss += workspaces[t].loss;
+        correct += workspaces[t].correct;
     }
-    int rows, cols;
-    // 保存 W1
-    rows = W1.rows();
-    cols = W1.cols();
-    out.write(reinterpret_cast<const char*>(&rows), sizeof(int));
-    out.write(reinterpret_cast<const char*>(&cols), sizeof(int));
-    out.write(reinterpret_cast<const char*>(W1.data()), sizeof(double) * rows * cols);
-    // 保存 b1
-    rows = b1.size();
-    out.write(reinterpret_cast<const char*>(&rows), sizeof(int));
-    out.write(reinterpret_cast<const char*>(b1.data()), sizeof(double) * rows);
-    // 保存 W2
-    rows = W2.rows();
-    cols = W2.cols();
-    out.write(reinterpret_cast<const char*>(&rows), sizeof(int));
-    out.write(reinterpret_cast<const char*>(&cols), sizeof(int));
-    out.write(reinterpret_cast<const char*>(W2.data()), sizeof(double) * rows * cols);
-    // 保存 b2
-    rows = b2.size();
-    out.write(reinterpret_cast<const char*>(&rows), sizeof(int));
-    out.write(reinterpret_cast<const char*>(b2.data()), sizeof(double) * rows);
-    out.close();
-}
-
-void NeuralNetwork::load_parameters(const std::string& filename) {
-    std::ifstream in(filename, std::ios::binary);
-    if (!in.is_open()) {
-        std::cerr << "无法打开文件加载参数: " << filename << std::endl;
+    return loss;
+}
+
+template <typename Scalar>
+template <typename Inputs>
+void BasicNeuralNetwork<Scalar>::forward_backward(const Inputs& X_train,
+                                                  const std::vector<uint8_t>& y_train,
+                                                  int begin, int end, Workspace& ws) const {
+    int n = end - begin;
+    ws.loss = 0.0;
+    ws.correct = 0;
+    // 每一列是一个样本：X [input_size x n]，只使用工作区的前 n 列
+    // 向前传播：稠密输入拼成矩阵做矩阵乘矩阵，稀疏输入逐列累加非零像素
+    auto A1 = ws.A1.leftCols(n);
+    if constexpr (is_sparse_inputs<Inputs, Scalar>()) {
+        for (int j = 0; j < n; ++j)
+            input_product(W1, X_train[begin + j], A1.col(j));
+    } else {
+        auto X = ws.X.leftCols(n);
+        gather_columns(X_train, begin, X);
+        gemm(A1, W1, X, Scalar(1), false, ws.gemm);
+    }
+    A1.colwise() += b1;
+    sigmoid_inplace<Scalar>(A1);
+    auto A2 = ws.A2.leftCols(n);
+    gemm(A2, W2, A1, Scalar(1), false, ws.gemm);
+    A2.colwise() += b2;
+    softmax_columns_inplace<Scalar>(A2);
+
+    // 反向传播：dZ2 = A2 - onehot(y)，原地覆盖 A2，只需在标签处减 1
+    auto dZ2 = A2;
+    for (int j = 0; j < n; ++j) {
+        int label = y_train[begin + j];
+        ws.loss += cross_entropy_loss(A2.col(j), label);
+        if (argmax(A2.col(j)) == label) ws.correct++;
+        dZ2(label, j) -= Scalar(1);
+    }
+
+    auto dZ1 = ws.dA1.leftCols(n);
+    gemm(dZ1, W2.transpose(), dZ2, Scalar(1), false, ws.gemm);
+    // sigmoid 的导数可直接由激活值得到：A1 * (1 - A1)
+    multiply_sigmoid_derivative<Scalar>(dZ1, A1);
+}
+
+template <typename Scalar>
+template <typename Inputs>
+void BasicNeuralNetwork<Scalar>::compute_gradients(const Inputs& X_train,
+                                                   const std::vector<uint8_t>& y_train,
+                                                   int begin, int end, Workspace& ws) const {
+    int n = end - begin;
+    if (n <= 0) {
+        ws.loss = 0.0;
+        ws.correct = 0;
+        ws.dW1.setZero();
+        ws.db1.setZero();
+        ws.dW2.setZero();
+        ws.db2.setZero();
         return;
     }
+    forward_backward(X_train, y_train, begin, end, ws);
+    auto dZ2 = ws.A2.leftCols(n);
+    auto dZ1 = ws.dA1.leftCols(n);
+    gemm(ws.dW2, dZ2, ws.A1.leftCols(n).transpose(), Scalar(1), false, ws.gemm);
+    ws.db2.noalias() = dZ2.rowwise().sum();
+    if constexpr (is_sparse_inputs<Inputs, Scalar>()) {
+        ws.dW1.setZero();
+        for (int j = 0; j < n; ++j)
+            subtract_outer(ws.dW1, dZ1.col(j), X_train[begin + j], Scalar(-1));
+    } else {
+        gemm(ws.dW1, dZ1, ws.X.leftCols(n).transpose(), Scalar(1), false, ws.gemm);
+    }
+    ws.db1.noalias() = dZ1.rowwise().sum();
+}
+
+template <typename Scalar>
+template <typename Inputs>
+double BasicNeuralNetwork<Scalar>::train_batch(const Inputs& X_train,
+                                               const std::vector<uint8_t>& y_train,
+                                               int begin, int end, Scalar learning_rate, int& correct,
+                                               ThreadPool* pool) {
+    int n = end - begin;
+    Scalar scale = learning_rate / n; // 梯度取批内平均
+    if (!pool) {
+        // 单线程：梯度矩阵乘积直接累加到权重上，不单独生成 dW1/dW2
+        Workspace& ws = workspaces[0];
+        forward_backward(X_train, y_train, begin, end, ws);
+        auto dZ2 = ws.A2.leftCols(n);
+        auto dZ1 = ws.dA1.leftCols(n);
+        gemm(W2, dZ2, ws.A1.leftCols(n).transpose(), -scale, true, ws.gemm);
+        b2.noalias() -= scale * dZ2.rowwise().sum();
+        if constexpr (is_sparse_inputs<Inputs, Scalar>()) {
+            for (int j = 0; j < n; ++j)
+                subtract_outer(W1, dZ1.col(j), X_train[begin + j], scale);
+        } else {
+            gemm(W1, dZ1, ws.X.leftCols(n).transpose(), -scale, true, ws.gemm);
+        }
+        b1.noalias() -= scale * dZ1.rowwise().sum();
+        correct += ws.correct;
+        return ws.loss;
+    }
+
+    int parts = pool->size();
+    int chunk = (n + parts - 1) / parts;
+    pool->run([&](int t) {
+        int lo = std::min(end, begin + t * chunk);
+        int hi = std::min(end, lo + chunk);
+        compute_gradients(X_train, y_train, lo, hi, workspaces[t]);
+    });
+    // 固定按线程编号顺序归约，保证结果可复现
+    Workspace& total = workspaces[0];
+    for (int t = 1; t < parts; ++t) {
+        total.dW1 += workspaces[t].dW1;
+        total.db1 += workspaces[t].db1;
+        total.dW2 += workspaces[t].dW2;
+        total.db2 += workspaces[t].db2;
+        total.loss += workspaces[t].loss;
+        total.correct += workspaces[t].correct;
+    }
+
+    // 梯度下降
+    W2 -= scale * total.dW2;
+    b2 -= scale * total.db2;
+    W1 -= scale * total.dW1;
+    b1 -= scale * total.db1;
+    correct += total.correct;
+    return total.loss;
+}
+
+namespace {
+
+// 旧格式参数文件：依次为 W1(rows, cols, data)、b1(rows, data)、W2(rows, cols, data)、b2(rows, data)，
+// 元素类型为 Stored（double 或 float）。按 Stored 解析，文件长度必须刚好吻合才算成功。
+template <typename Stored, typename Scalar>
+bool parse_parameters(const std::vector<char>& buf,
+                      MatrixX<Scalar>& W1, VectorX<Scalar>& b1,
+                      MatrixX<Scalar>& W2, VectorX<Scalar>& b2) {
+    size_t pos = 0;
+    auto read_int = [&](int& value) {
+        if (pos + sizeof(int) > buf.size()) return false;
+        std::memcpy(&value, buf.data() + pos, sizeof(int));
+        pos += sizeof(int);
+        return value >= 0;
+    };
+    auto read_data = [&](Scalar* dst, size_t count) {
+        if (count > (buf.size() - pos) / sizeof(Stored)) return false;
+        for (size_t i = 0; i < count; ++i) {
+            Stored value;
+            std::memcpy(&value, buf.data() + pos + i * sizeof(Stored), sizeof(Stored));
+            dst[i] = static_cast<Scalar>(value);
+        }
+        pos += count * sizeof(Stored);
+        return true;
+    };
+    // 维度取自文件：必须为正，且 rows * cols 个元素不超出剩余长度（用除法比较，避免乘法溢出），之后才分配
+    auto fits = [&](int rows, int cols) {
+        return rows > 0 && cols > 0 && size_t(cols) <= (buf.size() - pos) / sizeof(Stored) / size_t(rows);
+    };
     int rows, cols;
-    // 读取 W1
-    in.read(reinterpret_cast<char*>(&rows), sizeof(int));
-    in.read(reinterpret_cast<char*>(&cols), sizeof(int));
+    if (!read_int(rows) || !read_int(cols) || !fits(rows, cols)) return false;
     W1.resize(rows, cols);
-    in.read(reinterpret_cast<char*>(W1.data()), sizeof(double) * rows * cols);
-    // 读取 b1
-    in.read(reinterpret_cast<char*>(&rows), sizeof(int));
+    if (!read_data(W1.data(), W1.size())) return false;
+    if (!read_int(rows) || !fits(rows, 1)) return false;
     b1.resize(rows);
-    in.read(reinterpret_cast<char*>(b1.data()), sizeof(double) * rows);
-    // 读取 W2
-    in.read(reinterpret_cast<char*>(&rows), sizeof(int));
-    in.read(reinterpret_cast<char*>(&cols), sizeof(int));
+    if (!read_data(b1.data(), b1.size())) return false;
+    if (!read_int(rows) || !read_int(cols) || !fits(rows, cols)) return false;
     W2.resize(rows, cols);
-    in.read(reinterpret_cast<char*>(W2.data()), sizeof(double) * rows * cols);
-    // 读取 b2
-    in.read(reinterpret_cast<char*>(&rows), sizeof(int));
+    if (!read_data(W2.data(), W2.size())) return false;
+    if (!read_int(rows) || !fits(rows, 1)) return false;
     b2.resize(rows);
-    in.read(reinterpret_cast<char*>(b2.data()), sizeof(double) * rows);
-    in.close();
+    if (!read_data(b2.data(), b2.size())) return false;
+    return pos == buf.size() && W1.rows() == b1.size() && W2.cols() == W1.rows() && W2.rows() == b2.size();
 }
+
+// 新格式：拓扑为 输入 隐藏 输出 三层，张量依次为 W1 b1 W2 b2，形状必须与拓扑一致
+bool has_two_layer_topology(const ModelFile& file) {
+    const std::vector<uint32_t>& n = file.layers();
+    if (n.size() != 3 || file.num_tensors() != 4) return false;
+    auto shape = [&](size_t i, uint32_t rows, uint32_t cols) { return file.rows(i) == rows && file.cols(i) == cols; };
+    return shape(0, n[1], n[0]) && shape(1, n[1], 1) && shape(2, n[2], n[1]) && shape(3, n[2], 1);
+}
+
+} // namespace
+
+// 按当前标量类型以新格式保存（float 网络写出 float 文件）
+template <typename Scalar>
+bool BasicNeuralNetwork<Scalar>::save_parameters(const std::string& filename) const {
+    std::vector<uint32_t> layers = {uint32_t(input_size), uint32_t(hidden_size), uint32_t(output_size)};
+    auto tensor = [](const Scalar* data, Eigen::Index rows, Eigen::Index cols) {
+        return ModelTensor<Scalar>{data, uint32_t(rows), uint32_t(cols)};
+    };
+    return write_model_file<Scalar>(filename, layers,
+                                    {tensor(W1.data(), W1.rows(), W1.cols()), tensor(b1.data(), b1.size(), 1),
+                                     tensor(W2.data(), W2.rows(), W2.cols()), tensor(b2.data(), b2.size(), 1)});
+}
+
+// 新格式文件以 mmap 映射后复制各张量；旧格式（无文件头）自动识别元素是 double 还是 float
+// （由文件长度判断）。两种情况都转换为当前标量类型
+template <typename Scalar>
+bool BasicNeuralNetwork<Scalar>::load_parameters(const std::string& filename) {
+    Matrix w1, w2;
+    Vector v1, v2;
+    if (ModelFile::is_model_file(filename)) {
+        ModelFile file;
+        if (!file.open(filename)) return false;
+        if (!has_two_layer_topology(file)) {
+            std::cerr << "参数文件的网络结构与两层全连接网络不符: " << filename << std::endl;
+            return false;
+        }
+        w1 = file.read_tensor<Scalar>(0);
+        v1 = file.read_tensor<Scalar>(1);
+        w2 = file.read_tensor<Scalar>(2);
+        v2 = file.read_tensor<Scalar>(3);
+    } else {
+        std::ifstream in(filename, std::ios::binary);
+        if (!in.is_open()) {
+            std::cerr << "无法打开文件加载参数: " << filename << std::endl;
+            return false;
+        }
+        std::vector<char> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        if (!parse_parameters<double>(buf, w1, v1, w2, v2) &&
+            !parse_parameters<float>(buf, w1, v1, w2, v2)) {
+            std::cerr << "参数文件格式错误: " << filename << std::endl;
+            return false;
+        }
+    }
+    W1.swap(w1);
+    b1.swap(v1);
+    W2.swap(w2);
+    b2.swap(v2);
+    input_size = W1.cols();
+    hidden_size = W1.rows();
+    output_size = W2.rows();
+    return true;
+}
+
+template class BasicNeuralNetwork<float>;
+template class BasicNeuralNetwork<double>;
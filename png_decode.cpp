@@ -0,0 +1,213 @@
+#include "png_decode.h"
+#include <zlib.h>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+// 网页画布为 280x280。拒绝超过 1024x1024 的 8 位 RGBA（约 4 MB 解压数据）的图像，
+// 单个请求最多让工作线程申请这么多内存
+const uint32_t kMaxSide = 1024;
+const size_t kMaxRawBytes = (size_t(kMaxSide) * 4 + 1) * kMaxSide;
+// 解压缓冲区每个线程一份、常驻，超过这个大小的在本次解码结束后释放，长期只保留画布大小的缓冲区
+const size_t kRetainedScratchBytes = size_t(1) << 20;
+
+// libpng png_set_rgb_to_gray(…, 0.299, 0.587) 使用的 15 位定点系数（由 29900/100000、58700/100000 截断得到）
+const uint32_t kRedCoeff = 9797, kGreenCoeff = 19234, kBlueCoeff = 32768 - kRedCoeff - kGreenCoeff;
+
+enum ColorType { Gray = 0, Rgb = 2, Palette = 3, GrayAlpha = 4, Rgba = 6 };
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+int channel_count(int color_type) {
+    switch (color_type) {
+    case Gray: return 1;
+    case Rgb: return 3;
+    case Palette: return 1;
+    case GrayAlpha: return 2;
+    case Rgba: return 4;
+    default: return 0;
+    }
+}
+
+// 与 libpng 相同：8 位样本直接截断；16 位样本先带舍入转灰度，再取高字节
+uint8_t rgb_to_gray(uint32_t r, uint32_t g, uint32_t b) {
+    if (r == g && r == b) return static_cast<uint8_t>(r);
+    return static_cast<uint8_t>((kRedCoeff * r + kGreenCoeff * g + kBlueCoeff * b) >> 15);
+}
+
+uint8_t rgb16_to_gray(uint32_t r, uint32_t g, uint32_t b) {
+    if (r == g && r == b) return static_cast<uint8_t>(r >> 8);
+    return static_cast<uint8_t>(((kRedCoeff * r + kGreenCoeff * g + kBlueCoeff * b + 16384) >> 15) >> 8);
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// 就地还原一行的滤波，prev 为已还原的上一行（第一行时为全 0）
+bool unfilter_row(int filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    switch (filter) {
+    case 0: break;
+    case 1:
+        for (size_t i = bpp; i < length; ++i) row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i) row[i] = static_cast<uint8_t>(row[i] + prev[i]);
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp; ++i) row[i] = static_cast<uint8_t>(row[i] + (prev[i] >> 1));
+        for (size_t i = bpp; i < length; ++i) row[i] = static_cast<uint8_t>(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp; ++i) row[i] = static_cast<uint8_t>(row[i] + prev[i]);
+        for (size_t i = bpp; i < length; ++i)
+            row[i] = static_cast<uint8_t>(row[i] + paeth(row[i - bpp], prev[i], prev[i - bpp]));
+        break;
+    default: return false;
+    }
+    return true;
+}
+
+// 每个线程复用的解压缓冲区（每行带 1 字节滤波类型）
+struct PngScratch {
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> zero_row;
+};
+
+} // namespace
+
+bool decode_png_gray(const uint8_t* data, size_t size, PngImage& image) {
+    image.pixels.clear();
+    image.rows = image.cols = 0;
+    if (size < sizeof(kSignature) || std::memcmp(data, kSignature, sizeof(kSignature)) != 0) return false;
+
+    static thread_local PngScratch scratch;
+    struct ScratchTrim {
+        PngScratch& scratch;
+        ~ScratchTrim() {
+            if (scratch.raw.capacity() > kRetainedScratchBytes) std::vector<uint8_t>().swap(scratch.raw);
+        }
+    } trim{scratch};
+    uint32_t width = 0, height = 0;
+    int bit_depth = 0, color_type = -1;
+    std::array<uint8_t, 256> palette_gray{};
+    size_t raw_size = 0, raw_written = 0;
+    bool header_seen = false, stream_end = false;
+
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK) return false;
+    struct InflateGuard {
+        z_stream& zs;
+        ~InflateGuard() { inflateEnd(&zs); }
+    } guard{zs};
+
+    size_t pos = sizeof(kSignature);
+    for (;;) {
+        if (size - pos < 12) return false;
+        uint32_t length = read_be32(data + pos);
+        if (length > size - pos - 12) return false;
+        const uint8_t* type = data + pos + 4;
+        const uint8_t* body = data + pos + 8;
+        uint32_t crc = static_cast<uint32_t>(crc32(0L, type, length + 4));
+        if (crc != read_be32(body + length)) return false;
+        pos += size_t(length) + 12;
+
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            if (header_seen || length != 13) return false;
+            width = read_be32(body);
+            height = read_be32(body + 4);
+            bit_depth = body[8];
+            color_type = body[9];
+            // body[10..11]：压缩与滤波方式只有 0 一种；body[12] 为隔行扫描方式
+            if (width == 0 || height == 0 || width > kMaxSide || height > kMaxSide) return false;
+            if (channel_count(color_type) == 0 || body[10] != 0 || body[11] != 0 || body[12] != 0) return false;
+            if (bit_depth != 8 && !(bit_depth == 16 && color_type != Palette)) return false;
+            header_seen = true;
+            size_t row_bytes = size_t(width) * channel_count(color_type) * (bit_depth / 8);
+            raw_size = (row_bytes + 1) * height;
+            if (raw_size > kMaxRawBytes) return false; // 16 位或多通道的大图像
+            scratch.raw.resize(raw_size);
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            if (!header_seen || length % 3 != 0 || length / 3 > 256) return false;
+            for (uint32_t i = 0; i < length / 3; ++i)
+                palette_gray[i] = rgb_to_gray(body[3 * i], body[3 * i + 1], body[3 * i + 2]);
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            if (!header_seen) return false;
+            // IDAT 可分成多个块，逐块送入同一个 zlib 流，直接解压到整幅图像的缓冲区
+            zs.next_in = const_cast<Bytef*>(body);
+            zs.avail_in = length;
+            while (zs.avail_in > 0 && !stream_end) {
+                zs.next_out = scratch.raw.data() + raw_written;
+                zs.avail_out = static_cast<uInt>(raw_size - raw_written);
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                raw_written = raw_size - zs.avail_out;
+                if (ret == Z_STREAM_END) stream_end = true;
+                else if (ret != Z_OK) return false; // 数据损坏，或解压结果比图像尺寸还长（Z_BUF_ERROR）
+            }
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        } else if (!(type[0] & 0x20)) {
+            return false; // 不认识的关键块（类型首字母大写）
+        }
+    }
+    if (!header_seen || raw_written != raw_size) return false;
+
+    // 还原滤波并转换为 8 位灰度
+    const int channels = channel_count(color_type);
+    const size_t bytes_per_sample = bit_depth / 8;
+    const size_t bpp = channels * bytes_per_sample;
+    const size_t row_bytes = size_t(width) * bpp;
+    scratch.zero_row.assign(row_bytes, 0);
+    image.rows = static_cast<int>(height);
+    image.cols = static_cast<int>(width);
+    image.pixels.resize(size_t(width) * height);
+    const uint8_t* prev = scratch.zero_row.data();
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t* line = scratch.raw.data() + y * (row_bytes + 1);
+        uint8_t* row = line + 1;
+        if (!unfilter_row(line[0], row, prev, row_bytes, bpp)) {
+            image.pixels.clear();
+            image.rows = image.cols = 0;
+            return false;
+        }
+        prev = row;
+
+        uint8_t* out = image.pixels.data() + size_t(y) * width;
+        // 16 位样本为大端，高字节在前
+        auto sample = [&](uint32_t x, int c) { return row[(size_t(x) * channels + c) * bytes_per_sample]; };
+        auto sample16 = [&](uint32_t x, int c) {
+            const uint8_t* p = row + (size_t(x) * channels + c) * 2;
+            return (uint32_t(p[0]) << 8) | p[1];
+        };
+        switch (color_type) {
+        case Gray:
+        case GrayAlpha:
+            if (channels == 1 && bytes_per_sample == 1) {
+                std::memcpy(out, row, width);
+            } else {
+                for (uint32_t x = 0; x < width; ++x) out[x] = sample(x, 0);
+            }
+            break;
+        case Palette:
+            for (uint32_t x = 0; x < width; ++x) out[x] = palette_gray[row[x]];
+            break;
+        case Rgb:
+        case Rgba:
+            if (bytes_per_sample == 1) {
+                for (uint32_t x = 0; x < width; ++x) out[x] = rgb_to_gray(sample(x, 0), sample(x, 1), sample(x, 2));
+            } else {
+                for (uint32_t x = 0; x < width; ++x) out[x] = rgb16_to_gray(sample16(x, 0), sample16(x, 1), sample16(x, 2));
+            }
+            break;
+        }
+    }
+    return true;
+}
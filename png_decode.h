@@ -0,0 +1,25 @@
+#ifndef PNG_DECODE_H
+#define PNG_DECODE_H
+
+#include "preprocess.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 不依赖 OpenCV / libpng 的 PNG 解码（只用 zlib 解压 IDAT），输出 8 位灰度图，
+// 与 cv::imdecode(..., IMREAD_GRAYSCALE) 的结果一致：彩色按 libpng 的 0.299/0.587/0.114 定点系数转灰度，
+// alpha 通道直接丢弃，16 位样本取高 8 位。
+// 支持 8/16 位的灰度、灰度+alpha、RGB、RGBA 与 8 位调色板图像；不支持隔行扫描（Adam7）与 1/2/4 位图像；
+// 宽高不超过 1024，且解压后的数据不超过 1024x1024 的 8 位 RGBA 图像
+
+struct PngImage {
+    std::vector<uint8_t> pixels; // 行优先，每行 cols 字节
+    int rows = 0, cols = 0;
+
+    GrayImage view() const { return GrayImage{pixels.data(), rows, cols, static_cast<size_t>(cols)}; }
+};
+
+// 解码 data 指向的 size 字节 PNG 文件，格式不支持、数据损坏或 CRC 校验失败时返回 false
+bool decode_png_gray(const uint8_t* data, size_t size, PngImage& image);
+
+#endif
@@ -0,0 +1,260 @@
+#include "preprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#ifdef NR_USE_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace {
+
+const int kBinaryThreshold = 128; // 小于等于该值的像素视为笔画（与 THRESH_BINARY_INV 一致）
+const int kMargin = 10;           // 边界框四周保留的边距
+const double kMinVariance = 0.01; // 输出方差低于该值视为无效输入
+
+// 一个目标像素在一维上的取样范围：left 与 right 两端的部分覆盖像素各带权重，
+// 中间 [begin, end) 的像素权重相同，因此可以先对整段求和再乘一次权重
+struct AreaSpan {
+    int left, begin, end, right;
+    float left_weight, inner_weight, right_weight;
+};
+
+// 与 cv::resize(INTER_AREA) 相同的一维权重：缩小时按区域覆盖比例加权平均，
+// 放大时退化为 OpenCV INTER_AREA 的线性插值形式（只有两端，没有中间段）
+void build_area_spans(int src_size, AreaSpan* spans, int dst_size) {
+    double scale = static_cast<double>(src_size) / dst_size;
+    for (int dx = 0; dx < dst_size; ++dx) {
+        AreaSpan& span = spans[dx];
+        if (scale >= 1.0) {
+            double fsx1 = dx * scale;
+            double fsx2 = fsx1 + scale;
+            double cell = std::min(scale, src_size - fsx1);
+            int sx1 = static_cast<int>(std::ceil(fsx1));
+            int sx2 = std::min(static_cast<int>(std::floor(fsx2)), src_size - 1);
+            sx1 = std::min(sx1, sx2);
+            span.left = std::max(0, sx1 - 1);
+            span.left_weight = sx1 - fsx1 > 1e-3 ? static_cast<float>((sx1 - fsx1) / cell) : 0.f;
+            span.begin = sx1;
+            span.end = sx2;
+            span.inner_weight = static_cast<float>(1.0 / cell);
+            span.right = sx2;
+            span.right_weight = fsx2 - sx2 > 1e-3 ? static_cast<float>(std::min(std::min(fsx2 - sx2, 1.0), cell) / cell) : 0.f;
+        } else {
+            int sx = static_cast<int>(std::floor(dx * scale));
+            float fx = static_cast<float>((dx + 1) - (sx + 1) / scale);
+            fx = fx <= 0 ? 0.f : fx - std::floor(fx);
+            if (sx >= src_size - 1) {
+                sx = src_size - 1;
+                fx = 0.f;
+            }
+            span.left = sx;
+            span.left_weight = 1.f - fx;
+            span.begin = span.end = sx;
+            span.inner_weight = 0.f;
+            span.right = std::min(sx + 1, src_size - 1);
+            span.right_weight = fx;
+        }
+    }
+}
+
+// 输出的统计与方差检查
+PreprocessStatus finish(const float* out, PreprocessStats* stats) {
+    double sum = 0, lo = out[0], hi = out[0];
+    for (int i = 0; i < kDigitPixels; ++i) {
+        sum += out[i];
+        lo = std::min<double>(lo, out[i]);
+        hi = std::max<double>(hi, out[i]);
+    }
+    double mean = sum / kDigitPixels;
+    double variance = 0;
+    for (int i = 0; i < kDigitPixels; ++i) variance += (out[i] - mean) * (out[i] - mean);
+    variance /= kDigitPixels;
+    if (stats) {
+        stats->mean = mean;
+        stats->min = lo;
+        stats->max = hi;
+        stats->variance = variance;
+    }
+    return variance < kMinVariance ? PreprocessStatus::Blank : PreprocessStatus::Ok;
+}
+
+// 每个线程复用的缓冲区
+struct PreprocessScratch {
+    std::vector<uint8_t> col_ink;
+    std::vector<uint32_t> inner; // 目标行中间段各行在裁剪宽度上的逐列整数和
+    std::vector<float> column;   // 目标行在裁剪宽度上的竖直加权结果
+    AreaSpan spans[kDigitSide];
+};
+
+} // namespace
+
+PreprocessStatus preprocess_digit(const GrayImage& image, float* out, PreprocessStats* stats) {
+    static thread_local PreprocessScratch scratch;
+    if (image.rows <= 0 || image.cols <= 0) return PreprocessStatus::Blank;
+
+    // 第一遍：原图均值，以及每行/每列是否有笔画（投影）
+    std::vector<uint8_t>& col_ink = scratch.col_ink;
+    col_ink.assign(image.cols, 0);
+    // uint8_t 可与任何对象别名，尺寸与指针先取到局部变量，否则写 ink_cols 后编译器要重新读取它们，循环无法向量化
+    uint8_t* ink_cols = col_ink.data();
+    const int rows_count = image.rows, cols = image.cols;
+    uint64_t total = 0;
+    int y_min = rows_count, y_max = -1;
+    for (int y = 0; y < rows_count; ++y) {
+        const uint8_t* row = image.data + y * image.stride;
+        uint32_t row_sum = 0;
+        uint8_t row_ink = 0;
+        for (int x = 0; x < cols; ++x) row_sum += row[x];
+        for (int x = 0; x < cols; ++x) {
+            uint8_t ink = row[x] <= kBinaryThreshold;
+            ink_cols[x] |= ink;
+            row_ink |= ink;
+        }
+        total += row_sum;
+        if (row_ink) {
+            y_min = std::min(y_min, y);
+            y_max = y;
+        }
+    }
+    double source_mean = static_cast<double>(total) / (static_cast<double>(image.rows) * image.cols);
+    if (stats) *stats = PreprocessStats{};
+    if (stats) stats->source_mean = source_mean;
+    // 几乎全白（背景）或全黑，认为是空白图像
+    if (source_mean > 250 || source_mean < 5) return PreprocessStatus::Blank;
+    if (y_max < 0) return PreprocessStatus::Blank;
+    int x_min = static_cast<int>(std::find(col_ink.begin(), col_ink.end(), 1) - col_ink.begin());
+    int x_max = static_cast<int>(col_ink.rend() - std::find(col_ink.rbegin(), col_ink.rend(), 1)) - 1;
+    if (stats) {
+        stats->box_x = x_min;
+        stats->box_y = y_min;
+        stats->box_width = x_max - x_min + 1;
+        stats->box_height = y_max - y_min + 1;
+    }
+
+    // 加边距后裁剪，再居中放进白底正方形（与原实现相同的取整方式）
+    int x0 = std::max(0, x_min - kMargin);
+    int y0 = std::max(0, y_min - kMargin);
+    int width = std::min(image.cols - x0, x_max - x_min + 1 + 2 * kMargin);
+    int height = std::min(image.rows - y0, y_max - y_min + 1 + 2 * kMargin);
+    int side = std::max(width, height);
+    int offset_x = (side - width) / 2;
+    int offset_y = (side - height) / 2;
+
+    // 第二遍：只遍历裁剪区域，不生成裁剪/补边后的中间图像。
+    // 正方形两个方向的取样范围相同；补出来的白边像素按 255 计入。
+    // 每个目标行先在竖直方向合并：中间段的整行用整数累加，两端的行再按权重加上，
+    // 得到裁剪宽度上的一行浮点值后，再按水平取样范围合并成 28 个输出
+    const AreaSpan* spans = scratch.spans;
+    build_area_spans(side, scratch.spans, kDigitSide);
+    scratch.inner.resize(width);
+    scratch.column.resize(width);
+    uint32_t* inner = scratch.inner.data();
+    float* column = scratch.column.data();
+    auto source_row = [&](int Y) -> const uint8_t* {
+        int y = Y - offset_y;
+        return (y < 0 || y >= height) ? nullptr : image.data + (y0 + y) * image.stride + x0;
+    };
+    auto add_weighted_row = [&](int Y, float weight, float& padding) {
+        const uint8_t* row = source_row(Y);
+        if (!row) {
+            padding += weight * 255.f;
+            return;
+        }
+        for (int x = 0; x < width; ++x) column[x] += weight * row[x];
+    };
+    auto value_at = [&](int X, float padding) {
+        X -= offset_x;
+        return (X < 0 || X >= width) ? padding : column[X];
+    };
+    for (int i = 0; i < kDigitSide; ++i) {
+        const AreaSpan& sy = spans[i];
+        std::fill(inner, inner + width, 0u);
+        int padding_rows = 0;
+        for (int Y = sy.begin; Y < sy.end; ++Y) {
+            const uint8_t* row = source_row(Y);
+            if (!row) {
+                ++padding_rows;
+                continue;
+            }
+            for (int x = 0; x < width; ++x) inner[x] += row[x];
+        }
+        // 补边的列在竖直方向上也全是 255，其值等于各行权重之和乘 255
+        float padding = sy.inner_weight * 255.f * padding_rows;
+        for (int x = 0; x < width; ++x) column[x] = sy.inner_weight * static_cast<float>(inner[x]);
+        if (sy.left_weight != 0.f) add_weighted_row(sy.left, sy.left_weight, padding);
+        if (sy.right_weight != 0.f) add_weighted_row(sy.right, sy.right_weight, padding);
+        float column_padding = sy.inner_weight * 255.f * (sy.end - sy.begin) +
+                               sy.left_weight * 255.f * (sy.left_weight != 0.f) +
+                               sy.right_weight * 255.f * (sy.right_weight != 0.f);
+        for (int x = 0; x < width; ++x) column[x] += padding;
+        for (int j = 0; j < kDigitSide; ++j) {
+            const AreaSpan& sx = spans[j];
+            float run = 0.f;
+            int lo = std::max(sx.begin, offset_x), hi = std::min(sx.end, offset_x + width);
+            for (int X = lo; X < hi; ++X) run += column[X - offset_x];
+            run += column_padding * static_cast<float>((sx.end - sx.begin) - std::max(0, hi - lo));
+            float sum = sx.left_weight * value_at(sx.left, column_padding) + sx.inner_weight * run +
+                        sx.right_weight * value_at(sx.right, column_padding);
+            // 与 OpenCV 一样先取整为 8 位，再反色（白字黑底）并归一化到 [0,1]
+            float value = std::min(255.f, std::max(0.f, std::nearbyint(sum)));
+            out[i * kDigitSide + j] = (255.f - value) * (1.0f / 255.0f);
+        }
+    }
+    return finish(out, stats);
+}
+
+#ifdef NR_USE_OPENCV
+PreprocessStatus preprocess_digit_opencv(const GrayImage& image, float* out, PreprocessStats* stats) {
+    cv::Mat img(image.rows, image.cols, CV_8UC1, const_cast<uint8_t*>(image.data), image.stride);
+    if (stats) *stats = PreprocessStats{};
+
+    // 检查是否为空白图像（几乎全白或全黑）
+    cv::Scalar mean_val_orig = cv::mean(img);
+    if (stats) stats->source_mean = mean_val_orig[0];
+    if (mean_val_orig[0] > 250 || mean_val_orig[0] < 5) return PreprocessStatus::Blank;
+
+    // 寻找内容边界框，裁剪掉多余的空白部分
+    cv::Mat binary;
+    cv::threshold(img, binary, kBinaryThreshold, 255, cv::THRESH_BINARY_INV);
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    if (contours.empty()) return PreprocessStatus::Blank;
+
+    // 找到最大的轮廓（假设是数字）
+    cv::Rect boundingBox = cv::boundingRect(contours[0]);
+    for (size_t i = 1; i < contours.size(); ++i) {
+        cv::Rect rect = cv::boundingRect(contours[i]);
+        if (rect.area() > boundingBox.area()) boundingBox = rect;
+    }
+    if (stats) {
+        stats->box_x = boundingBox.x;
+        stats->box_y = boundingBox.y;
+        stats->box_width = boundingBox.width;
+        stats->box_height = boundingBox.height;
+    }
+
+    // 添加一些边距
+    boundingBox.x = std::max(0, boundingBox.x - kMargin);
+    boundingBox.y = std::max(0, boundingBox.y - kMargin);
+    boundingBox.width = std::min(img.cols - boundingBox.x, boundingBox.width + 2 * kMargin);
+    boundingBox.height = std::min(img.rows - boundingBox.y, boundingBox.height + 2 * kMargin);
+    cv::Mat cropped = img(boundingBox);
+
+    // 创建正方形图像，保持宽高比
+    int maxDim = std::max(cropped.rows, cropped.cols);
+    cv::Mat square = cv::Mat::ones(maxDim, maxDim, CV_8UC1) * 255; // 白色背景
+    int offsetX = (maxDim - cropped.cols) / 2;
+    int offsetY = (maxDim - cropped.rows) / 2;
+    cropped.copyTo(square(cv::Rect(offsetX, offsetY, cropped.cols, cropped.rows)));
+
+    // 调整到 28x28，反转颜色（Canvas 是黑字白底，MNIST 是白字黑底），归一化到 [0,1]
+    cv::Mat resized;
+    cv::resize(square, resized, cv::Size(kDigitSide, kDigitSide), 0, 0, cv::INTER_AREA);
+    cv::bitwise_not(resized, resized);
+    resized.convertTo(resized, CV_32F, 1.0 / 255.0);
+    for (int i = 0; i < kDigitSide; ++i)
+        for (int j = 0; j < kDigitSide; ++j)
+            out[i * kDigitSide + j] = resized.at<float>(i, j);
+    return finish(out, stats);
+}
+#endif
@@ -0,0 +1,42 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 网页画布（黑字白底的灰度图）-> 28x28 的 MNIST 风格网络输入（白字黑底，[0,1]，行优先）
+
+// 不复制数据的灰度图视图，stride 为相邻两行首地址相差的字节数
+struct GrayImage {
+    const uint8_t* data;
+    int rows, cols;
+    size_t stride;
+};
+
+enum class PreprocessStatus {
+    Ok,
+    Blank, // 空白、没有笔画或变化太小，拒绝识别
+};
+
+// 用于日志的统计信息
+struct PreprocessStats {
+    double source_mean = 0;          // 原图均值
+    int box_x = 0, box_y = 0, box_width = 0, box_height = 0; // 内容边界框（未加边距）
+    double mean = 0, min = 0, max = 0, variance = 0;           // 输出的统计
+};
+
+const int kDigitSide = 28;
+const int kDigitPixels = kDigitSide * kDigitSide;
+
+// 快速实现：行/列投影求所有笔画的边界框（不提取轮廓），然后在一次遍历中完成
+// 裁剪、补成正方形、区域插值缩放到 28x28、反色和归一化，直接写入 out（kDigitPixels 个 float）。
+// 中间缓冲区为每个线程一份，重复调用不申请内存。返回 Blank 时 out 的内容无意义
+PreprocessStatus preprocess_digit(const GrayImage& image, float* out, PreprocessStats* stats = nullptr);
+
+#ifdef NR_USE_OPENCV
+// 原先基于 OpenCV 的实现（阈值化 + findContours 取面积最大的轮廓 + cv::resize），用于对照测试。
+// 与快速实现的区别：多笔画时这里只取最大轮廓的边界框，快速实现取全部笔画的边界框
+PreprocessStatus preprocess_digit_opencv(const GrayImage& image, float* out, PreprocessStats* stats = nullptr);
+#endif
+
+#endif
@@ -0,0 +1,312 @@
+#include "quantized_net.h"
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NR_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// uint8 x int8 -> int32 矩阵乘：out[j * rows + r] = sum_i W[r * k + i] * X[j * k + i]，
+// k 为 32 的倍数。每次计算 4 行权重 x 2 个样本的小块，一次读入的权重与样本各复用多次。
+//   VNNI：vpdpbusd 一条指令完成 32 对 uint8 x int8 乘加到 8 个 int32，不会饱和；
+//   AVX2：先扩展为 int16 再用 vpmaddwd。vpmaddubsw 虽然少一步扩展，但 255 x 127 x 2 会在 int16 饱和，
+//         结果不再精确，所以不用；
+//   标量：逐元素累加。
+// 三者的累加结果完全相同。
+// ---------------------------------------------------------------------------
+namespace {
+
+const size_t kRowAlignment = 32;
+
+size_t align_row(size_t n) { return (n + kRowAlignment - 1) / kRowAlignment * kRowAlignment; }
+
+Int8Kernel detect_int8_kernel() {
+#ifdef NR_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avxvnni") ||
+        (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")))
+        return Int8Kernel::VNNI;
+    if (__builtin_cpu_supports("avx2")) return Int8Kernel::AVX2;
+#endif
+    return Int8Kernel::Scalar;
+}
+
+const Int8Kernel g_detected_kernel = detect_int8_kernel();
+#ifdef NR_X86_SIMD
+const bool g_avx_vnni = __builtin_cpu_supports("avxvnni"); // 否则 VNNI 内核使用 AVX-512 VNNI
+#endif
+std::atomic<Int8Kernel> g_int8_kernel{g_detected_kernel};
+
+struct ScalarDot {
+    template <int R, int S>
+    static void tile(const int8_t* W, const uint8_t* X, size_t k, int rows, int32_t* out) {
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) {
+                const int8_t* w = W + r * k;
+                const uint8_t* x = X + s * k;
+                int32_t sum = 0;
+                for (size_t i = 0; i < k; ++i) sum += int32_t(w[i]) * int32_t(x[i]);
+                out[s * rows + r] = sum;
+            }
+    }
+};
+
+#ifdef NR_X86_SIMD
+
+__attribute__((target("avx2"))) inline int32_t hsum_epi32(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+struct Avx2Dot {
+    template <int R, int S>
+    __attribute__((target("avx2"))) static void tile(const int8_t* W, const uint8_t* X, size_t k, int rows, int32_t* out) {
+        __m256i acc[S][R];
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) acc[s][r] = _mm256_setzero_si256();
+        // 每次 16 个元素：vpmovzxbw / vpmovsxbw 直接从内存读入并扩展，不需要先拆分高低 128 位
+        for (size_t i = 0; i < k; i += 16) {
+            __m256i x[S];
+            for (int s = 0; s < S; ++s)
+                x[s] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(X + s * k + i)));
+            for (int r = 0; r < R; ++r) {
+                __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(W + r * k + i)));
+                for (int s = 0; s < S; ++s) acc[s][r] = _mm256_add_epi32(acc[s][r], _mm256_madd_epi16(x[s], w));
+            }
+        }
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) out[s * rows + r] = hsum_epi32(acc[s][r]);
+    }
+};
+
+// AVX-VNNI（VEX 编码）与 AVX-512 VNNI（EVEX 编码的 256 位版本）指令相同，分别供不同的 CPU 使用
+struct AvxVnniDot {
+    template <int R, int S>
+    __attribute__((target("avx2,avxvnni"))) static void tile(const int8_t* W, const uint8_t* X, size_t k, int rows, int32_t* out) {
+        __m256i acc[S][R];
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) acc[s][r] = _mm256_setzero_si256();
+        for (size_t i = 0; i < k; i += 32) {
+            __m256i x[S];
+            for (int s = 0; s < S; ++s) x[s] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(X + s * k + i));
+            for (int r = 0; r < R; ++r) {
+                __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(W + r * k + i));
+                for (int s = 0; s < S; ++s) acc[s][r] = _mm256_dpbusd_avx_epi32(acc[s][r], x[s], w);
+            }
+        }
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) out[s * rows + r] = hsum_epi32(acc[s][r]);
+    }
+};
+
+struct Avx512VnniDot {
+    template <int R, int S>
+    __attribute__((target("avx2,avx512vnni,avx512vl"))) static void tile(const int8_t* W, const uint8_t* X, size_t k, int rows, int32_t* out) {
+        __m256i acc[S][R];
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) acc[s][r] = _mm256_setzero_si256();
+        for (size_t i = 0; i < k; i += 32) {
+            __m256i x[S];
+            for (int s = 0; s < S; ++s) x[s] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(X + s * k + i));
+            for (int r = 0; r < R; ++r) {
+                __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(W + r * k + i));
+                for (int s = 0; s < S; ++s) acc[s][r] = _mm256_dpbusd_epi32(acc[s][r], x[s], w);
+            }
+        }
+        for (int s = 0; s < S; ++s)
+            for (int r = 0; r < R; ++r) out[s * rows + r] = hsum_epi32(acc[s][r]);
+    }
+};
+
+#endif // NR_X86_SIMD
+
+// 按 4 行 x 2 个样本分块，剩余的行与样本用更小的块处理
+template <typename Dot>
+void gemm_u8s8(const int8_t* W, int rows, const uint8_t* X, int n, size_t k, int32_t* out) {
+    int j = 0;
+    for (; j + 2 <= n; j += 2) {
+        int r = 0;
+        for (; r + 4 <= rows; r += 4) Dot::template tile<4, 2>(W + r * k, X + j * k, k, rows, out + j * rows + r);
+        for (; r < rows; ++r) Dot::template tile<1, 2>(W + r * k, X + j * k, k, rows, out + j * rows + r);
+    }
+    for (; j < n; ++j) {
+        int r = 0;
+        for (; r + 4 <= rows; r += 4) Dot::template tile<4, 1>(W + r * k, X + j * k, k, rows, out + j * rows + r);
+        for (; r < rows; ++r) Dot::template tile<1, 1>(W + r * k, X + j * k, k, rows, out + j * rows + r);
+    }
+}
+
+void gemm_kernel(const int8_t* W, int rows, const uint8_t* X, int n, size_t k, int32_t* out) {
+    switch (g_int8_kernel.load(std::memory_order_relaxed)) {
+#ifdef NR_X86_SIMD
+    case Int8Kernel::VNNI:
+        if (g_avx_vnni) gemm_u8s8<AvxVnniDot>(W, rows, X, n, k, out);
+        else gemm_u8s8<Avx512VnniDot>(W, rows, X, n, k, out);
+        return;
+    case Int8Kernel::AVX2: gemm_u8s8<Avx2Dot>(W, rows, X, n, k, out); return;
+#endif
+    default: gemm_u8s8<ScalarDot>(W, rows, X, n, k, out); return;
+    }
+}
+
+// 按行对称量化：dest 每行 stride 个元素（补齐部分为 0），返回每行的比例
+template <typename Scalar>
+VectorX<float> quantize_rows(const MatrixX<Scalar>& W, size_t stride, std::vector<int8_t>& dest) {
+    VectorX<float> scales(W.rows());
+    dest.assign(W.rows() * stride, 0);
+    for (Eigen::Index r = 0; r < W.rows(); ++r) {
+        double max_abs = static_cast<double>(W.row(r).cwiseAbs().maxCoeff());
+        double scale = max_abs > 0 ? max_abs / 127.0 : 1.0;
+        for (Eigen::Index c = 0; c < W.cols(); ++c) {
+            double q = std::nearbyint(static_cast<double>(W(r, c)) / scale);
+            dest[r * stride + c] = static_cast<int8_t>(std::min(127.0, std::max(-127.0, q)));
+        }
+        scales(r) = static_cast<float>(scale);
+    }
+    return scales;
+}
+
+// 每块样本数：第一层的 uint8 输入约 200 KB，与权重一起留在 L2 中
+const int kChunk = 256;
+
+// 推理用的临时缓冲区，每个线程一份，只增不减
+struct QuantizedScratch {
+    std::vector<uint8_t> X, H; // 量化后的输入与隐藏层激活，每个样本一行
+    std::vector<int32_t> acc;
+    MatrixX<float> A1, A2;
+};
+
+QuantizedScratch& quantized_scratch() {
+    static thread_local QuantizedScratch scratch;
+    return scratch;
+}
+
+void ensure_capacity(MatrixX<float>& m, Eigen::Index rows, Eigen::Index cols) {
+    if (m.rows() != rows || m.cols() < cols) m.resize(rows, std::max(cols, m.cols()));
+}
+
+// 补齐部分必须为 0：扩容时整体清零，之后每个样本只写前面的有效字节
+void ensure_size(std::vector<uint8_t>& v, size_t size) {
+    if (v.size() < size) v.assign(size, 0);
+}
+
+} // namespace
+
+Int8Kernel detected_int8_kernel() { return g_detected_kernel; }
+void set_int8_kernel(Int8Kernel kernel) {
+    g_int8_kernel.store(static_cast<int>(kernel) > static_cast<int>(g_detected_kernel) ? g_detected_kernel : kernel);
+}
+Int8Kernel int8_kernel() { return g_int8_kernel.load(); }
+const char* int8_kernel_name(Int8Kernel kernel) {
+    switch (kernel) {
+    case Int8Kernel::VNNI: return "VNNI";
+    case Int8Kernel::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+template <typename Scalar>
+QuantizedNetwork::QuantizedNetwork(const BasicNeuralNetwork<Scalar>& net)
+    : input_size(net.num_inputs()), hidden_size(static_cast<int>(net.hidden_bias().size())),
+      output_size(net.num_outputs()), input_stride(align_row(input_size)), hidden_stride(align_row(hidden_size)),
+      hidden_scale(1.0f / 255)
+{
+    // 输入比例固定为 1/255：uint8 像素直接作为量化值
+    scale1 = quantize_rows(net.hidden_weights(), input_stride, W1) / 255.0f;
+    w2_scale = quantize_rows(net.output_weights(), hidden_stride, W2);
+    scale2 = w2_scale * hidden_scale;
+    b1 = net.hidden_bias().template cast<float>();
+    b2 = net.output_bias().template cast<float>();
+}
+
+template QuantizedNetwork::QuantizedNetwork(const BasicNeuralNetwork<float>&);
+template QuantizedNetwork::QuantizedNetwork(const BasicNeuralNetwork<double>&);
+
+void QuantizedNetwork::hidden_activations(const uint8_t* x, int n, Matrix& A1) const {
+    QuantizedScratch& scratch = quantized_scratch();
+    if (scratch.acc.size() < size_t(hidden_size) * n) scratch.acc.resize(size_t(hidden_size) * n);
+    gemm_kernel(W1.data(), hidden_size, x, n, input_stride, scratch.acc.data());
+    ensure_capacity(A1, hidden_size, n);
+    Eigen::Map<const Eigen::Matrix<int32_t, Eigen::Dynamic, Eigen::Dynamic>> acc(scratch.acc.data(), hidden_size, n);
+    auto Z1 = A1.leftCols(n);
+    Z1 = (acc.cast<float>().array().colwise() * scale1.array()).colwise() + b1.array();
+    sigmoid_inplace<float>(Z1);
+}
+
+void QuantizedNetwork::calibrate(const uint8_t* pixels, size_t count) {
+    if (count == 0) return;
+    std::vector<uint8_t> X(input_stride * kChunk, 0);
+    Matrix A1;
+    float max_activation = 0.0f;
+    for (size_t begin = 0; begin < count; begin += kChunk) {
+        int n = static_cast<int>(std::min<size_t>(kChunk, count - begin));
+        for (int j = 0; j < n; ++j)
+            std::memcpy(&X[j * input_stride], pixels + (begin + j) * input_size, input_size);
+        hidden_activations(X.data(), n, A1);
+        max_activation = std::max(max_activation, A1.leftCols(n).maxCoeff());
+    }
+    if (max_activation <= 0.0f) return;
+    hidden_scale = max_activation / 255.0f;
+    scale2 = w2_scale * hidden_scale;
+}
+
+Eigen::Block<QuantizedNetwork::Matrix, Eigen::Dynamic, Eigen::Dynamic, true>
+QuantizedNetwork::forward_quantized(const uint8_t* x, int n) const {
+    QuantizedScratch& scratch = quantized_scratch();
+    hidden_activations(x, n, scratch.A1);
+
+    // 隐藏层激活（非负）量化为 uint8，超出校准范围的截断为 255
+    ensure_size(scratch.H, hidden_stride * n);
+    const float inverse = 1.0f / hidden_scale;
+    for (int j = 0; j < n; ++j) {
+        const float* a = scratch.A1.col(j).data();
+        uint8_t* h = &scratch.H[j * hidden_stride];
+        for (int r = 0; r < hidden_size; ++r)
+            h[r] = static_cast<uint8_t>(std::min(255.0f, a[r] * inverse + 0.5f));
+    }
+
+    if (scratch.acc.size() < size_t(output_size) * n) scratch.acc.resize(size_t(output_size) * n);
+    gemm_kernel(W2.data(), output_size, scratch.H.data(), n, hidden_stride, scratch.acc.data());
+    ensure_capacity(scratch.A2, output_size, n);
+    Eigen::Map<const Eigen::Matrix<int32_t, Eigen::Dynamic, Eigen::Dynamic>> acc(scratch.acc.data(), output_size, n);
+    auto A2 = scratch.A2.leftCols(n);
+    A2 = (acc.cast<float>().array().colwise() * scale2.array()).colwise() + b2.array();
+    softmax_columns_inplace<float>(A2);
+    return A2;
+}
+
+QuantizedNetwork::Vector QuantizedNetwork::forward(const Vector& input) const {
+    QuantizedScratch& scratch = quantized_scratch();
+    ensure_size(scratch.X, input_stride);
+    for (int i = 0; i < input_size; ++i)
+        scratch.X[i] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, input(i) * 255.0f + 0.5f)));
+    return forward_quantized(scratch.X.data(), 1).col(0);
+}
+
+int QuantizedNetwork::predict(const Vector& input) const {
+    return argmax(forward(input));
+}
+
+std::vector<int> QuantizedNetwork::predict_batch(const uint8_t* pixels, size_t count, Matrix* probabilities) const {
+    std::vector<int> labels(count);
+    if (probabilities) probabilities->resize(output_size, count);
+    QuantizedScratch& scratch = quantized_scratch();
+    ensure_size(scratch.X, input_stride * std::min<size_t>(kChunk, count));
+    for (size_t begin = 0; begin < count; begin += kChunk) {
+        int n = static_cast<int>(std::min<size_t>(kChunk, count - begin));
+        for (int j = 0; j < n; ++j)
+            std::memcpy(&scratch.X[j * input_stride], pixels + (begin + j) * input_size, input_size);
+        auto A2 = forward_quantized(scratch.X.data(), n);
+        for (int j = 0; j < n; ++j)
+            labels[begin + j] = argmax(A2.col(j));
+        if (probabilities) probabilities->middleCols(begin, n) = A2;
+    }
+    return labels;
+}
@@ -0,0 +1,64 @@
+#ifndef QUANTIZED_NET_H
+#define QUANTIZED_NET_H
+
+#include "neural_net.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// int8 点积内核：VNNI（vpdpbusd，AVX-VNNI 或 AVX-512 VNNI）/ AVX2 / 标量，运行时按 CPU 支持情况选择。
+// 各内核的 int32 累加结果完全相同，set_int8_kernel 只影响速度
+enum class Int8Kernel { Scalar, AVX2, VNNI };
+Int8Kernel detected_int8_kernel();
+void set_int8_kernel(Int8Kernel kernel); // 不会超过 CPU 实际支持的级别
+Int8Kernel int8_kernel();
+const char* int8_kernel_name(Int8Kernel kernel);
+
+// 训练后量化的推理网络（只用于推理）：
+//   权重按行对称量化为 int8，每行一个比例 max|w| / 127；
+//   输入像素本身就是 uint8（x = p / 255），隐藏层 sigmoid 激活量化为 uint8，比例由校准确定；
+//   两层都以 uint8 x int8 -> int32 累加，再乘以两个比例并加上 float 偏置，softmax 仍用 float。
+// 权重约为 float 网络的 1/4。推理接口为 const 且可重入（临时缓冲区为每个线程一份）
+class QuantizedNetwork {
+public:
+    using Vector = VectorX<float>;
+    using Matrix = MatrixX<float>;
+
+    template <typename Scalar>
+    explicit QuantizedNetwork(const BasicNeuralNetwork<Scalar>& net);
+
+    // 用 count 张连续存放的 uint8 图像统计隐藏层激活的最大值，作为其量化范围；
+    // 未校准时取 sigmoid 的值域 [0, 1]
+    void calibrate(const uint8_t* pixels, size_t count);
+    float hidden_range() const { return hidden_scale * 255.0f; }
+
+    int num_inputs() const { return input_size; }
+    int num_outputs() const { return output_size; }
+    size_t weight_bytes() const { return W1.size() + W2.size(); }
+
+    // input 为 [0, 1] 的像素值，按 1/255 的步长量化
+    Vector forward(const Vector& input) const;
+    int predict(const Vector& input) const;
+    // 连续存放的 count 张 uint8 图像（每张 input_size 字节），按块批量推理
+    std::vector<int> predict_batch(const uint8_t* pixels, size_t count,
+                                   Matrix* probabilities = nullptr) const;
+
+private:
+    int input_size, hidden_size, output_size;
+    // 每行（每个样本）补齐到 32 字节的倍数，补齐部分为 0，内核不处理尾部
+    size_t input_stride, hidden_stride;
+
+    std::vector<int8_t> W1, W2; // 按行存储 [hidden_size x input_stride]、[output_size x hidden_stride]
+    Vector scale1, scale2;      // 每行的反量化系数：权重比例 x 输入（激活）比例
+    Vector w2_scale;            // 第二层每行的权重比例，校准后据此重新计算 scale2
+    Vector b1, b2;
+    float hidden_scale;         // 隐藏层激活的量化比例
+
+    // n 个已量化并补齐的样本（x 每个 input_stride 字节）前向传播，
+    // 返回当前线程缓冲区中的概率 [output_size x n]
+    Eigen::Block<Matrix, Eigen::Dynamic, Eigen::Dynamic, true> forward_quantized(const uint8_t* x, int n) const;
+    // 第一层：反量化后的 sigmoid 激活写入 A1 [hidden_size x n]
+    void hidden_activations(const uint8_t* x, int n, Matrix& A1) const;
+};
+
+#endif
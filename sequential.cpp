@@ -0,0 +1,281 @@
+#include "sequential.h"
+#include "model_file.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+template <typename Scalar>
+void ensure_capacity(MatrixX<Scalar>& m, Eigen::Index rows, Eigen::Index cols) {
+    if (m.rows() != rows || m.cols() < cols) m.resize(rows, std::max(cols, m.cols()));
+}
+
+// 推理用的各层输出与矩阵乘法缓冲区，每个线程一份，只增不减
+template <typename Scalar>
+struct InferenceScratch {
+    std::vector<MatrixX<Scalar>> outputs;
+    GemmBuffers<Scalar> gemm;
+};
+
+template <typename Scalar>
+InferenceScratch<Scalar>& inference_scratch() {
+    static thread_local InferenceScratch<Scalar> scratch;
+    return scratch;
+}
+
+} // namespace
+
+template <typename Scalar>
+std::unique_ptr<Sequential<Scalar>> Sequential<Scalar>::create(const std::vector<int>& sizes) {
+    if (sizes.size() < 2 || std::any_of(sizes.begin(), sizes.end(), [](int n) { return n <= 0; })) {
+        std::cerr << "网络结构至少需要两层，且各层神经元数必须为正" << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<Sequential>(new Sequential(sizes, true));
+}
+
+template <typename Scalar>
+Sequential<Scalar>::Sequential(const std::vector<int>& sizes, bool initialize) : layer_sizes(sizes) {
+    size_t offset = 0;
+    for (size_t l = 0; l + 1 < layer_sizes.size(); ++l) {
+        auto dense = std::make_unique<Dense<Scalar>>(layer_sizes[l], layer_sizes[l + 1]);
+        dense->set_offset(offset);
+        offset += dense->num_parameters();
+        dense_layers.push_back(dense.get());
+        stack.push_back(std::move(dense));
+        if (l + 2 < layer_sizes.size())
+            stack.push_back(std::make_unique<Sigmoid<Scalar>>(layer_sizes[l + 1]));
+    }
+    stack.push_back(std::make_unique<SoftmaxCrossEntropy<Scalar>>(layer_sizes.back()));
+    params = Vector::Zero(offset);
+    if (initialize) {
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        for (const auto& layer : stack) layer->initialize(params.data(), gen);
+    }
+}
+
+// 新格式：按文件中的拓扑建立各层，张量依次为各全连接层的 W、b；
+// 旧的无文件头格式只有两层，交给 BasicNeuralNetwork 解析后复制
+template <typename Scalar>
+std::unique_ptr<Sequential<Scalar>> Sequential<Scalar>::from_file(const std::string& filename) {
+    if (!ModelFile::is_model_file(filename)) {
+        std::unique_ptr<BasicNeuralNetwork<Scalar>> net = BasicNeuralNetwork<Scalar>::from_file(filename);
+        if (!net) return nullptr;
+        int hidden = static_cast<int>(net->hidden_bias().size());
+        std::unique_ptr<Sequential> model(new Sequential({net->num_inputs(), hidden, net->num_outputs()}, false));
+        Scalar* p = model->params.data();
+        for (const Matrix& m : {net->hidden_weights(), Matrix(net->hidden_bias()),
+                                net->output_weights(), Matrix(net->output_bias())}) {
+            std::copy(m.data(), m.data() + m.size(), p);
+            p += m.size();
+        }
+        return model;
+    }
+
+    ModelFile file;
+    if (!file.open(filename)) return nullptr;
+    const std::vector<uint32_t>& n = file.layers();
+    bool valid = n.size() >= 2 && file.num_tensors() == 2 * (n.size() - 1);
+    for (size_t l = 0; valid && l + 1 < n.size(); ++l) {
+        valid = file.rows(2 * l) == n[l + 1] && file.cols(2 * l) == n[l] &&
+                file.rows(2 * l + 1) == n[l + 1] && file.cols(2 * l + 1) == 1;
+    }
+    if (!valid) {
+        std::cerr << "参数文件的张量与网络拓扑不符: " << filename << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<Sequential> model(new Sequential(std::vector<int>(n.begin(), n.end()), false));
+    // 各张量在扁平数组中首尾相接，依次复制（并按需转换类型）
+    Scalar* p = model->params.data();
+    for (size_t i = 0; i < file.num_tensors(); ++i) {
+        Eigen::Map<Matrix> dest(p, file.rows(i), file.cols(i));
+        dest = file.read_tensor<Scalar>(i);
+        p += dest.size();
+    }
+    return model;
+}
+
+template <typename Scalar>
+bool Sequential<Scalar>::save_parameters(const std::string& filename) const {
+    std::vector<uint32_t> layers(layer_sizes.begin(), layer_sizes.end());
+    std::vector<ModelTensor<Scalar>> tensors;
+    for (const Dense<Scalar>* dense : dense_layers) {
+        const Scalar* segment = params.data() + dense->offset();
+        uint32_t rows = dense->output_size(), cols = dense->input_size();
+        tensors.push_back({segment, rows, cols});
+        tensors.push_back({segment + size_t(rows) * cols, rows, 1});
+    }
+    return write_model_file<Scalar>(filename, layers, tensors);
+}
+
+template <typename Scalar>
+typename Sequential<Scalar>::Matrix Sequential<Scalar>::forward_batch(const Eigen::Ref<const Matrix>& inputs) const {
+    InferenceScratch<Scalar>& scratch = inference_scratch<Scalar>();
+    std::vector<Matrix>& outputs = scratch.outputs;
+    if (outputs.size() < stack.size()) outputs.resize(stack.size());
+    Eigen::Index n = inputs.cols();
+    for (size_t l = 0; l < stack.size(); ++l) {
+        ensure_capacity(outputs[l], stack[l]->output_size(), n);
+        if (l == 0)
+            stack[l]->forward(params.data(), inputs, outputs[l].leftCols(n), scratch.gemm);
+        else
+            stack[l]->forward(params.data(), outputs[l - 1].leftCols(n), outputs[l].leftCols(n), scratch.gemm);
+    }
+    return outputs[stack.size() - 1].leftCols(n);
+}
+
+template <typename Scalar>
+typename Sequential<Scalar>::Vector Sequential<Scalar>::forward(const Vector& input) const {
+    return forward_batch(input);
+}
+
+template <typename Scalar>
+int Sequential<Scalar>::predict(const Vector& input) const {
+    return argmax(forward_batch(input).col(0));
+}
+
+template <typename Scalar>
+std::vector<int> Sequential<Scalar>::predict_batch(const uint8_t* pixels, size_t count, Matrix* probabilities) const {
+    const size_t chunk = 1024;
+    std::vector<int> labels(count);
+    if (probabilities) probabilities->resize(num_outputs(), count);
+    Matrix X(num_inputs(), static_cast<Eigen::Index>(std::min(chunk, count)));
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        Eigen::Index n = static_cast<Eigen::Index>(std::min(chunk, count - begin));
+        Eigen::Map<const Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic>> bytes(
+            pixels + begin * num_inputs(), num_inputs(), n);
+        X.leftCols(n) = bytes.cast<Scalar>() * Scalar(1.0 / 255);
+        Matrix P = forward_batch(X.leftCols(n));
+        for (Eigen::Index j = 0; j < n; ++j)
+            labels[begin + j] = argmax(P.col(j));
+        if (probabilities) probabilities->middleCols(begin, n) = P;
+    }
+    return labels;
+}
+
+template <typename Scalar>
+void Sequential<Scalar>::reserve(Workspace& ws, int batch_capacity) const {
+    ws.X.resize(num_inputs(), batch_capacity);
+    ws.outputs.resize(stack.size());
+    ws.grads.resize(stack.size());
+    for (size_t l = 0; l < stack.size(); ++l) {
+        ws.outputs[l].resize(stack[l]->output_size(), batch_capacity);
+        ws.grads[l].resize(stack[l]->input_size(), batch_capacity);
+    }
+    ws.gradients.resize(params.size());
+}
+
+template <typename Scalar>
+void Sequential<Scalar>::forward_backward(const Eigen::Ref<const Matrix>& X, const uint8_t* labels,
+                                          Workspace& ws) const {
+    Eigen::Index n = X.cols();
+    size_t last = stack.size() - 1;
+    for (size_t l = 0; l < stack.size(); ++l) {
+        if (l == 0)
+            stack[l]->forward(params.data(), X, ws.outputs[l].leftCols(n), ws.gemm);
+        else
+            stack[l]->forward(params.data(), ws.outputs[l - 1].leftCols(n), ws.outputs[l].leftCols(n), ws.gemm);
+    }
+    // 输出层的 softmax 与交叉熵合并求梯度，之后逐层向前传播
+    ws.correct = 0;
+    const auto& loss = static_cast<const SoftmaxCrossEntropy<Scalar>&>(*stack[last]);
+    ws.loss = loss.loss_gradient(ws.outputs[last].leftCols(n), labels, ws.grads[last].leftCols(n), ws.correct);
+    ws.gradients.setZero();
+    for (size_t l = last; l-- > 0;) {
+        if (l == 0)
+            stack[l]->backward(params.data(), X, ws.outputs[l].leftCols(n), ws.grads[l + 1].leftCols(n),
+                               ws.grads[l].leftCols(n), false, ws.gradients.data(), ws.gemm);
+        else
+            stack[l]->backward(params.data(), ws.outputs[l - 1].leftCols(n), ws.outputs[l].leftCols(n),
+                               ws.grads[l + 1].leftCols(n), ws.grads[l].leftCols(n), true, ws.gradients.data(),
+                               ws.gemm);
+    }
+}
+
+template <typename Scalar>
+double Sequential<Scalar>::loss_and_gradients(const Eigen::Ref<const Matrix>& inputs, const uint8_t* labels,
+                                              Vector& gradients) const {
+    Workspace ws;
+    reserve(ws, static_cast<int>(inputs.cols()));
+    forward_backward(inputs, labels, ws);
+    gradients = ws.gradients;
+    return ws.loss;
+}
+
+template <typename Scalar>
+double Sequential<Scalar>::train_batch(const MnistImages& X_train, const std::vector<uint8_t>& y_train,
+                                       int begin, int end, Scalar learning_rate, int& correct, ThreadPool* pool) {
+    int parts = pool ? pool->size() : 1;
+    int chunk = (end - begin + parts - 1) / parts;
+    auto compute = [&](int t) {
+        Workspace& ws = workspaces[t];
+        int lo = std::min(end, begin + t * chunk);
+        int hi = std::min(end, lo + chunk);
+        if (hi <= lo) {
+            ws.gradients.setZero();
+            ws.loss = 0.0;
+            ws.correct = 0;
+            return;
+        }
+        auto X = ws.X.leftCols(hi - lo);
+        X = X_train.matrix().middleCols(lo, hi - lo).template cast<Scalar>() * Scalar(1.0 / 255);
+        forward_backward(X, y_train.data() + lo, ws);
+    };
+    if (pool) pool->run(compute);
+    else compute(0);
+
+    // 固定按线程编号顺序归约，保证结果可复现；归约与更新都是对整个扁平数组的一次运算
+    Workspace& total = workspaces[0];
+    for (int t = 1; t < parts; ++t) {
+        total.gradients += workspaces[t].gradients;
+        total.loss += workspaces[t].loss;
+        total.correct += workspaces[t].correct;
+    }
+    params.noalias() -= (learning_rate / (end - begin)) * total.gradients; // 批内平均梯度
+    correct += total.correct;
+    return total.loss;
+}
+
+template <typename Scalar>
+void Sequential<Scalar>::train(const MnistImages& X_train, const std::vector<uint8_t>& y_train,
+                               const TrainOptions& options) {
+    int n_samples = static_cast<int>(X_train.size());
+    if (y_train.size() != X_train.size() || X_train.pixels() != num_inputs()) {
+        std::cerr << "训练数据与网络输入不符: " << X_train.size() << " 张 " << X_train.pixels() << " 像素的图像, "
+                  << y_train.size() << " 个标签" << std::endl;
+        return;
+    }
+    for (uint8_t label : y_train) {
+        if (label >= num_outputs()) {
+            std::cerr << "标签超出输出层范围: " << int(label) << std::endl;
+            return;
+        }
+    }
+    if (options.hogwild) std::cerr << "多层网络不支持 Hogwild，将使用小批量 SGD" << std::endl;
+    Scalar learning_rate = static_cast<Scalar>(options.learning_rate);
+    int batch_size = std::max(1, options.batch_size);
+    int num_threads = std::max(1, std::min(options.num_threads, batch_size));
+    std::unique_ptr<ThreadPool> pool;
+    if (num_threads > 1) pool.reset(new ThreadPool(num_threads));
+    // 每个线程一份工作区，训练开始前一次性分配好，之后每一步复用
+    workspaces.resize(num_threads);
+    for (Workspace& ws : workspaces) reserve(ws, (batch_size + num_threads - 1) / num_threads);
+
+    for (int epoch = 0; epoch < options.epochs; ++epoch) {
+        double total_loss = 0.0;
+        int correct = 0;
+        for (int begin = 0; begin < n_samples; begin += batch_size) {
+            int end = std::min(n_samples, begin + batch_size);
+            total_loss += train_batch(X_train, y_train, begin, end, learning_rate, correct, pool.get());
+        }
+        std::cout << "Epoch " << epoch + 1
+                  << " | 损失: " << std::fixed << std::setprecision(4) << total_loss / n_samples
+                  << " | 准确率: " << (100.0 * correct / n_samples) << "%" << std::endl;
+    }
+}
+
+template class Sequential<float>;
+template class Sequential<double>;
@@ -0,0 +1,86 @@
+#ifndef SEQUENTIAL_H
+#define SEQUENTIAL_H
+
+#include "layers.h"
+#include "neural_net.h"
+#include "mnist_loader.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// 由若干层顺序组成的多层全连接网络，例如 784-256-128-10：
+//   Dense -> Sigmoid -> Dense -> Sigmoid -> ... -> Dense -> SoftmaxCrossEntropy
+// 全部参数连续存放在一个扁平数组中（各全连接层依次为 W 按列存储、b），梯度数组布局相同，
+// 因此多线程梯度归约、参数更新都是对整个数组的一次运算，保存时各张量直接指向数组中的对应段。
+// 参数文件与 BasicNeuralNetwork 格式相同（见 model_file.h），784-128-10 的文件两者可以互相读取。
+// 目前用于训练与命令行的测试/转换模式；网页服务、int8 与 FixedNetwork 仍使用两层的 BasicNeuralNetwork。
+// Scalar 为 float 或 double（实现位于 sequential.cpp 并显式实例化）
+template <typename Scalar>
+class Sequential {
+public:
+    using Vector = VectorX<Scalar>;
+    using Matrix = MatrixX<Scalar>;
+
+    // sizes 为各层神经元数，参数随机初始化（Xavier），用于训练；少于两层或有非正的层大小时返回空指针
+    static std::unique_ptr<Sequential> create(const std::vector<int>& sizes);
+    // 从参数文件创建，层数与尺寸取自文件（也可读取旧的无文件头两层参数文件）；失败时返回空指针
+    static std::unique_ptr<Sequential> from_file(const std::string& filename);
+
+    Sequential(const Sequential&) = delete;
+    Sequential& operator=(const Sequential&) = delete;
+
+    const std::vector<int>& sizes() const { return layer_sizes; }
+    int num_inputs() const { return layer_sizes.front(); }
+    int num_outputs() const { return layer_sizes.back(); }
+    const std::vector<std::unique_ptr<Layer<Scalar>>>& layers() const { return stack; }
+    // 全部参数（扁平数组）
+    Vector& parameters() { return params; }
+    const Vector& parameters() const { return params; }
+
+    // 推理接口均为 const 且可重入（临时缓冲区为每个线程一份）
+    Vector forward(const Vector& input) const;
+    int predict(const Vector& input) const;
+    // inputs 每列一个样本，返回每列的 softmax 概率
+    Matrix forward_batch(const Eigen::Ref<const Matrix>& inputs) const;
+    // 连续存放的 count 张 uint8 图像，按块转换为浮点数后批量推理
+    std::vector<int> predict_batch(const uint8_t* pixels, size_t count, Matrix* probabilities = nullptr) const;
+
+    // 小批量 SGD（options.batch_size、num_threads 有效；不支持 Hogwild 与稀疏输入）
+    void train(const MnistImages& X_train, const std::vector<uint8_t>& y_train, const TrainOptions& options);
+    // inputs 每列一个样本：返回交叉熵损失之和，gradients 为各样本梯度之和（与参数同样布局），用于梯度检查
+    double loss_and_gradients(const Eigen::Ref<const Matrix>& inputs, const uint8_t* labels, Vector& gradients) const;
+
+    bool save_parameters(const std::string& filename) const;
+
+private:
+    // sizes 已检查过；initialize 为 false 时参数为 0，由调用方填入
+    Sequential(const std::vector<int>& sizes, bool initialize);
+
+    std::vector<int> layer_sizes;
+    std::vector<std::unique_ptr<Layer<Scalar>>> stack; // 最后一层为 SoftmaxCrossEntropy
+    std::vector<const Dense<Scalar>*> dense_layers;     // 保存/加载时按顺序对应文件中的张量
+    Vector params;
+
+    // 训练用的缓冲区，每个线程一份，训练开始时按每个线程负责的最大样本数分配，实际只用前 n 列
+    struct Workspace {
+        Matrix X;
+        std::vector<Matrix> outputs; // outputs[l] 为第 l 层的输出
+        std::vector<Matrix> grads;   // grads[l] 为损失对第 l 层输入的梯度
+        Vector gradients;            // 这段样本的参数梯度之和
+        GemmBuffers<Scalar> gemm;    // 各全连接层矩阵乘法共用的打包缓冲区
+        double loss = 0.0;
+        int correct = 0;
+    };
+    std::vector<Workspace> workspaces;
+
+    void reserve(Workspace& ws, int batch_capacity) const;
+    // 前向与反向传播 X 的前 n 列：梯度之和写入 ws.gradients，并记录损失与正确数
+    void forward_backward(const Eigen::Ref<const Matrix>& X, const uint8_t* labels, Workspace& ws) const;
+    // 一个小批量 [begin, end)：pool 非空时按线程切分后按线程编号顺序归约，再用批内平均梯度更新参数
+    double train_batch(const MnistImages& X_train, const std::vector<uint8_t>& y_train, int begin, int end,
+                       Scalar learning_rate, int& correct, ThreadPool* pool);
+};
+
+#endif
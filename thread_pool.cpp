@@ -0,0 +1,46 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads < 1) num_threads = 1;
+    workers.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::run_task(const std::function<void(int)>& task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    current_task = &task;
+    pending = size();
+    ++generation;
+    start_cv.notify_all();
+    done_cv.wait(lock, [this] { return pending == 0; });
+    current_task = nullptr;
+}
+
+void ThreadPool::worker_loop(int index) {
+    unsigned long seen = 0;
+    for (;;) {
+        const std::function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            task = current_task;
+        }
+        (*task)(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) done_cv.notify_one();
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 常驻线程池：run(task) 让每个工作线程以自己的编号执行一次 task，并阻塞到全部完成
+class ThreadPool {
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()); }
+    // task 以引用方式包装成 std::function（std::cref），捕获较多的 lambda 也不会在每次调用时申请堆内存
+    template <typename Task>
+    void run(const Task& task) { run_task(std::cref(task)); }
+
+private:
+    void run_task(const std::function<void(int)>& task);
+    void worker_loop(int index);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_cv, done_cv;
+    const std::function<void(int)>* current_task = nullptr;
+    unsigned long generation = 0; // 每提交一次任务加一，唤醒工作线程
+    int pending = 0;               // 尚未完成当前任务的线程数
+    bool stopping = false;
+};
+
+#endif
@@ -1,36 +1,379 @@
 #include "util.h"
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NR_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// float 激活函数内核：AVX-512 / AVX2 / 标量三个版本，运行时按 CPU 支持情况选择。
+// exp 用 2^n * p(r) 计算（r = x - n*ln2，|r| <= ln2/2）：
+//   精确模式 p 为 Cephes expf 的 6 次多项式，误差接近 float 精度；
+//   快速模式 p 为 3 次泰勒多项式，相对误差约 1e-3 以内，sigmoid 绝对误差约 1e-4。
+// double 版本仍由 Eigen 计算，不受模式影响。
+// ---------------------------------------------------------------------------
+namespace {
+
+std::atomic<ActivationMode> g_activation_mode{ActivationMode::Exact};
+
+SimdLevel detect_simd_level() {
+#ifdef NR_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const SimdLevel g_detected_level = detect_simd_level();
+std::atomic<SimdLevel> g_simd_level{g_detected_level};
+
+const float kExpMin = -87.0f; // 限制输入范围，保证 2^n 的指数不溢出
+const float kExpMax = 88.0f;
+const float kLog2e = 1.44269504088896341f;
+const float kLn2Hi = 0.693359375f;
+const float kLn2Lo = -2.12194440e-4f;
+
+// 标量版本的近似 exp，与向量版本使用同一多项式，用于处理尾部元素
+template <bool Fast>
+inline float exp_poly(float x) {
+    x = std::min(std::max(x, kExpMin), kExpMax);
+    float n = std::nearbyint(x * kLog2e);
+    float r = x - n * kLn2Hi - n * kLn2Lo;
+    float p;
+    if (Fast) {
+        p = 1.0f + r * (1.0f + r * (0.5f + r * (1.0f / 6.0f)));
+    } else {
+        p = 1.9875691500e-4f;
+        p = p * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        p = p * r * r + r + 1.0f;
+    }
+    // 直接构造 2^n 的浮点位模式，n 在 [-126, 127] 内
+    uint32_t bits = static_cast<uint32_t>(static_cast<int>(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+void sigmoid_scalar(float* p, size_t n, bool fast) {
+    if (fast) {
+        for (size_t i = 0; i < n; ++i) p[i] = 1.0f / (1.0f + exp_poly<true>(-p[i]));
+    } else {
+        for (size_t i = 0; i < n; ++i) p[i] = 1.0f / (1.0f + std::exp(-p[i]));
+    }
+}
+
+// p[i] = exp(p[i] - shift)，返回它们的和
+float exp_shifted_scalar(float* p, size_t n, float shift, bool fast) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        p[i] = fast ? exp_poly<true>(p[i] - shift) : std::exp(p[i] - shift);
+        sum += p[i];
+    }
+    return sum;
+}
+
+void sigmoid_backward_scalar(float* delta, const float* a, size_t n) {
+    for (size_t i = 0; i < n; ++i) delta[i] *= a[i] * (1.0f - a[i]);
+}
+
+#ifdef NR_X86_SIMD
+
+template <bool Fast>
+__attribute__((target("avx2,fma"))) inline __m256 exp_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(kExpMin)), _mm256_set1_ps(kExpMax));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(kLog2e)),
+                               _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), r);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 p;
+    if (Fast) {
+        p = _mm256_fmadd_ps(_mm256_set1_ps(1.0f / 6.0f), r, _mm256_set1_ps(0.5f));
+        p = _mm256_fmadd_ps(p, r, one);
+        p = _mm256_fmadd_ps(p, r, one);
+    } else {
+        p = _mm256_set1_ps(1.9875691500e-4f);
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+        p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, one));
+    }
+    __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+template <bool Fast>
+__attribute__((target("avx2,fma"))) void sigmoid_avx2(float* p, size_t n) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 e = exp_avx2<Fast>(_mm256_sub_ps(zero, _mm256_loadu_ps(p + i)));
+        _mm256_storeu_ps(p + i, _mm256_div_ps(one, _mm256_add_ps(one, e)));
+    }
+    for (; i < n; ++i) p[i] = 1.0f / (1.0f + exp_poly<Fast>(-p[i]));
+}
+
+template <bool Fast>
+__attribute__((target("avx2,fma"))) float exp_shifted_avx2(float* p, size_t n, float shift) {
+    const __m256 s = _mm256_set1_ps(shift);
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 e = exp_avx2<Fast>(_mm256_sub_ps(_mm256_loadu_ps(p + i), s));
+        _mm256_storeu_ps(p + i, e);
+        acc = _mm256_add_ps(acc, e);
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, acc);
+    float sum = 0.0f;
+    for (float v : lanes) sum += v;
+    for (; i < n; ++i) {
+        p[i] = exp_poly<Fast>(p[i] - shift);
+        sum += p[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) void sigmoid_backward_avx2(float* delta, const float* a, size_t n) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 av = _mm256_loadu_ps(a + i);
+        __m256 d = _mm256_mul_ps(av, _mm256_sub_ps(one, av));
+        _mm256_storeu_ps(delta + i, _mm256_mul_ps(_mm256_loadu_ps(delta + i), d));
+    }
+    sigmoid_backward_scalar(delta + i, a + i, n - i);
+}
+
+template <bool Fast>
+__attribute__((target("avx512f"))) inline __m512 exp_avx512(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(kExpMin)), _mm512_set1_ps(kExpMax));
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(kLog2e)),
+                                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Hi), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Lo), r);
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 p;
+    if (Fast) {
+        p = _mm512_fmadd_ps(_mm512_set1_ps(1.0f / 6.0f), r, _mm512_set1_ps(0.5f));
+        p = _mm512_fmadd_ps(p, r, one);
+        p = _mm512_fmadd_ps(p, r, one);
+    } else {
+        p = _mm512_set1_ps(1.9875691500e-4f);
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+        p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, one));
+    }
+    return _mm512_scalef_ps(p, n);
+}
+
+template <bool Fast>
+__attribute__((target("avx512f"))) void sigmoid_avx512(float* p, size_t n) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+        __m512 e = exp_avx512<Fast>(_mm512_sub_ps(zero, _mm512_maskz_loadu_ps(m, p + i)));
+        _mm512_mask_storeu_ps(p + i, m, _mm512_div_ps(one, _mm512_add_ps(one, e)));
+    }
+}
+
+template <bool Fast>
+__attribute__((target("avx512f"))) float exp_shifted_avx512(float* p, size_t n, float shift) {
+    const __m512 s = _mm512_set1_ps(shift);
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+        __m512 e = exp_avx512<Fast>(_mm512_sub_ps(_mm512_maskz_loadu_ps(m, p + i), s));
+        _mm512_mask_storeu_ps(p + i, m, e);
+        acc = _mm512_mask_add_ps(acc, m, acc, e);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) void sigmoid_backward_avx512(float* delta, const float* a, size_t n) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? __mmask16(0xFFFF) : __mmask16((1u << (n - i)) - 1);
+        __m512 av = _mm512_maskz_loadu_ps(m, a + i);
+        __m512 d = _mm512_mul_ps(av, _mm512_sub_ps(one, av));
+        _mm512_mask_storeu_ps(delta + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, delta + i), d));
+    }
+}
+
+#endif // NR_X86_SIMD
+
+// 连续内存上的内核分派
+void sigmoid_kernel(float* p, size_t n) {
+    bool fast = g_activation_mode.load(std::memory_order_relaxed) == ActivationMode::Fast;
+    switch (g_simd_level.load(std::memory_order_relaxed)) {
+#ifdef NR_X86_SIMD
+    case SimdLevel::AVX512: fast ? sigmoid_avx512<true>(p, n) : sigmoid_avx512<false>(p, n); return;
+    case SimdLevel::AVX2: fast ? sigmoid_avx2<true>(p, n) : sigmoid_avx2<false>(p, n); return;
+#endif
+    default: sigmoid_scalar(p, n, fast); return;
+    }
+}
+
+void sigmoid_kernel(double* p, size_t n) {
+    Eigen::Map<Eigen::ArrayXd> a(p, n);
+    a = 1.0 / (1.0 + (-a).exp());
+}
+
+float exp_shifted_kernel(float* p, size_t n, float shift) {
+    bool fast = g_activation_mode.load(std::memory_order_relaxed) == ActivationMode::Fast;
+    switch (g_simd_level.load(std::memory_order_relaxed)) {
+#ifdef NR_X86_SIMD
+    case SimdLevel::AVX512: return fast ? exp_shifted_avx512<true>(p, n, shift) : exp_shifted_avx512<false>(p, n, shift);
+    case SimdLevel::AVX2: return fast ? exp_shifted_avx2<true>(p, n, shift) : exp_shifted_avx2<false>(p, n, shift);
+#endif
+    default: return exp_shifted_scalar(p, n, shift, fast);
+    }
+}
+
+double exp_shifted_kernel(double* p, size_t n, double shift) {
+    Eigen::Map<Eigen::ArrayXd> a(p, n);
+    a = (a - shift).exp();
+    return a.sum();
+}
+
+void sigmoid_backward_kernel(float* delta, const float* a, size_t n) {
+    switch (g_simd_level.load(std::memory_order_relaxed)) {
+#ifdef NR_X86_SIMD
+    case SimdLevel::AVX512: sigmoid_backward_avx512(delta, a, n); return;
+    case SimdLevel::AVX2: sigmoid_backward_avx2(delta, a, n); return;
+#endif
+    default: sigmoid_backward_scalar(delta, a, n); return;
+    }
+}
+
+void sigmoid_backward_kernel(double* delta, const double* a, size_t n) {
+    Eigen::Map<Eigen::ArrayXd> d(delta, n);
+    d *= Eigen::Map<const Eigen::ArrayXd>(a, n) * (1.0 - Eigen::Map<const Eigen::ArrayXd>(a, n));
+}
+
+} // namespace
+
+void set_activation_mode(ActivationMode mode) { g_activation_mode.store(mode); }
+ActivationMode activation_mode() { return g_activation_mode.load(); }
+
+SimdLevel detected_simd_level() { return g_detected_level; }
+void set_simd_level(SimdLevel level) {
+    g_simd_level.store(static_cast<int>(level) > static_cast<int>(g_detected_level) ? g_detected_level : level);
+}
+SimdLevel simd_level() { return g_simd_level.load(); }
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX512: return "AVX-512";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
 //激活函数 sigmoid(z) = 1 / (1+exp(-z))
-Eigen::VectorXd sigmoid(const Eigen::VectorXd& z) {
-    return 1.0 / (1.0 + (-z.array()).exp());
+template <typename Scalar>
+VectorX<Scalar> sigmoid(const VectorX<Scalar>& z) {
+    VectorX<Scalar> s = z;
+    sigmoid_inplace<Scalar>(s);
+    return s;
 }
 //激活函数的导数 Dsigmoid(z) = sigmoid(z) * (1 - sigmoid(z))
-Eigen::VectorXd sigmoid_derivative(const Eigen::VectorXd& z) {
-    Eigen::VectorXd s = sigmoid(z);
-    return s.array() * (1 - s.array());
+template <typename Scalar>
+VectorX<Scalar> sigmoid_derivative(const VectorX<Scalar>& z) {
+    return sigmoid_derivative_from_activation<Scalar>(sigmoid(z));
+}
+//已知 a = sigmoid(z) 时的导数 a * (1 - a)
+template <typename Scalar>
+VectorX<Scalar> sigmoid_derivative_from_activation(const VectorX<Scalar>& a) {
+    return a.array() * (Scalar(1) - a.array());
 }
 //softmax函数 softmax(z) = exp(z) / sum(exp(z))
-Eigen::VectorXd softmax(const Eigen::VectorXd& z) {
-    Eigen::ArrayXd exp_z = (z.array() - z.maxCoeff()).exp(); // 防止溢出
-    return exp_z / exp_z.sum();
+template <typename Scalar>
+VectorX<Scalar> softmax(const VectorX<Scalar>& z) {
+    VectorX<Scalar> s = z;
+    softmax_columns_inplace<Scalar>(s);
+    return s;
+}
+//逐元素 sigmoid，用于小批量矩阵
+template <typename Scalar>
+MatrixX<Scalar> sigmoid(const MatrixX<Scalar>& z) {
+    MatrixX<Scalar> s = z;
+    sigmoid_inplace<Scalar>(s);
+    return s;
+}
+//按列做 softmax，每列减去自己的最大值防止溢出
+template <typename Scalar>
+MatrixX<Scalar> softmax_columns(const MatrixX<Scalar>& z) {
+    MatrixX<Scalar> s = z;
+    softmax_columns_inplace<Scalar>(s);
+    return s;
 }
-//交叉熵损失函数 
-// L(y, y_hat) = -sum(y * log(y_hat))
-double cross_entropy_loss(const Eigen::VectorXd& predicted,
-                          const Eigen::VectorXd& actual) {
-    const double epsilon = 1e-12;
-    return - (actual.array() * (predicted.array() + epsilon).log()).sum();
+//原地 sigmoid：列之间连续时整块处理，否则逐列处理
+template <typename Scalar>
+void sigmoid_inplace(Eigen::Ref<MatrixX<Scalar>> z) {
+    if (z.outerStride() == z.rows()) {
+        sigmoid_kernel(z.data(), static_cast<size_t>(z.size()));
+    } else {
+        for (Eigen::Index j = 0; j < z.cols(); ++j)
+            sigmoid_kernel(z.col(j).data(), static_cast<size_t>(z.rows()));
+    }
+}
+//原地按列 softmax，每列减去自己的最大值防止溢出
+template <typename Scalar>
+void softmax_columns_inplace(Eigen::Ref<MatrixX<Scalar>> z) {
+    for (Eigen::Index j = 0; j < z.cols(); ++j) {
+        auto col = z.col(j);
+        Scalar sum = exp_shifted_kernel(col.data(), static_cast<size_t>(z.rows()), col.maxCoeff());
+        col /= sum;
+    }
+}
+//原地 delta *= a * (1 - a)
+template <typename Scalar>
+void multiply_sigmoid_derivative(Eigen::Ref<MatrixX<Scalar>> delta, const Eigen::Ref<const MatrixX<Scalar>>& a) {
+    if (delta.outerStride() == delta.rows() && a.outerStride() == a.rows()) {
+        sigmoid_backward_kernel(delta.data(), a.data(), static_cast<size_t>(delta.size()));
+    } else {
+        for (Eigen::Index j = 0; j < delta.cols(); ++j)
+            sigmoid_backward_kernel(delta.col(j).data(), a.col(j).data(), static_cast<size_t>(delta.rows()));
+    }
 }
 //one-hot标签
-Eigen::VectorXd one_hot(int label, int num_classes) {
-    Eigen::VectorXd v = Eigen::VectorXd::Zero(num_classes);
-    v(label) = 1.0;
+template <typename Scalar>
+VectorX<Scalar> one_hot(int label, int num_classes) {
+    VectorX<Scalar> v = VectorX<Scalar>::Zero(num_classes);
+    v(label) = Scalar(1);
     return v;
 }
-//返回最有可能的数
-int argmax(const Eigen::VectorXd& vec) {
-    Eigen::Index maxIndex;
-    vec.maxCoeff(&maxIndex);
-    return static_cast<int>(maxIndex);
-}
+
+// 显式实例化 float 与 double 两个版本
+#define INSTANTIATE_UTIL(Scalar)                                            \
+    template VectorX<Scalar> sigmoid<Scalar>(const VectorX<Scalar>&);       \
+    template VectorX<Scalar> sigmoid_derivative<Scalar>(const VectorX<Scalar>&); \
+    template VectorX<Scalar> sigmoid_derivative_from_activation<Scalar>(const VectorX<Scalar>&); \
+    template VectorX<Scalar> softmax<Scalar>(const VectorX<Scalar>&);       \
+    template MatrixX<Scalar> sigmoid<Scalar>(const MatrixX<Scalar>&);       \
+    template MatrixX<Scalar> softmax_columns<Scalar>(const MatrixX<Scalar>&); \
+    template void sigmoid_inplace<Scalar>(Eigen::Ref<MatrixX<Scalar>>);     \
+    template void softmax_columns_inplace<Scalar>(Eigen::Ref<MatrixX<Scalar>>); \
+    template void multiply_sigmoid_derivative<Scalar>(Eigen::Ref<MatrixX<Scalar>>, \
+                                                      const Eigen::Ref<const MatrixX<Scalar>>&); \
+    template VectorX<Scalar> one_hot<Scalar>(int, int);
+INSTANTIATE_UTIL(float)
+INSTANTIATE_UTIL(double)
+#undef INSTANTIATE_UTIL
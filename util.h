@@ -3,22 +3,85 @@
 
 #include <Eigen/Dense>
 
+#include <cmath>
+#include <type_traits>
 #include <vector>
+
+// 按标量类型参数化的向量/矩阵（float 或 double）
+template <typename Scalar>
+using VectorX = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+template <typename Scalar>
+using MatrixX = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+
+// float 激活函数的 exp 计算方式：Exact 误差接近 float 精度；Fast 用低阶多项式近似，
+// sigmoid 绝对误差约 1e-4、速度更快。double 始终使用精确计算
+enum class ActivationMode { Exact, Fast };
+void set_activation_mode(ActivationMode mode);
+ActivationMode activation_mode();
+
+// float 激活函数使用的向量指令集，默认取 CPU 支持的最高级别；
+// set_simd_level 可以降级（例如测试标量版本），但不会超过 CPU 实际支持的级别
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+SimdLevel detected_simd_level();
+void set_simd_level(SimdLevel level);
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+
 //激活函数
-Eigen::VectorXd sigmoid(const Eigen::VectorXd& z);
+template <typename Scalar>
+VectorX<Scalar> sigmoid(const VectorX<Scalar>& z);
 //激活函数导数
-Eigen::VectorXd sigmoid_derivative(const Eigen::VectorXd& z);
+template <typename Scalar>
+VectorX<Scalar> sigmoid_derivative(const VectorX<Scalar>& z);
+//已知激活值 a = sigmoid(z) 时的导数 a * (1 - a)，不必重新计算 sigmoid
+template <typename Scalar>
+VectorX<Scalar> sigmoid_derivative_from_activation(const VectorX<Scalar>& a);
 //softmax函数，表示数字0到9的概率
-Eigen::VectorXd softmax(const Eigen::VectorXd& z);
+template <typename Scalar>
+VectorX<Scalar> softmax(const VectorX<Scalar>& z);
 
-//损失函数
-double cross_entropy_loss(const Eigen::VectorXd& predicted,
-                          const Eigen::VectorXd& actual);
+//小批量版本：矩阵的每一列是一个样本
+template <typename Scalar>
+MatrixX<Scalar> sigmoid(const MatrixX<Scalar>& z);
+template <typename Scalar>
+MatrixX<Scalar> softmax_columns(const MatrixX<Scalar>& z);
+
+//原地版本，不申请内存：z 可以是向量，也可以是每列一个样本的矩阵（或其中连续的若干列）
+template <typename Scalar>
+void sigmoid_inplace(Eigen::Ref<MatrixX<Scalar>> z);
+template <typename Scalar>
+void softmax_columns_inplace(Eigen::Ref<MatrixX<Scalar>> z);
+//反向传播用：delta *= a * (1 - a)，a 为 sigmoid 激活值
+template <typename Scalar>
+void multiply_sigmoid_derivative(Eigen::Ref<MatrixX<Scalar>> delta, const Eigen::Ref<const MatrixX<Scalar>>& a);
 
 //工具函数，将标签转换为独热编码
-Eigen::VectorXd one_hot(int label, int num_classes = 10);
+template <typename Scalar = double>
+VectorX<Scalar> one_hot(int label, int num_classes = 10);
+
+//损失函数 L(y, y_hat) = -sum(y * log(y_hat))，可直接传入矩阵的某一列
+template <typename DerivedP, typename DerivedA>
+double cross_entropy_loss(const Eigen::MatrixBase<DerivedP>& predicted,
+                          const Eigen::MatrixBase<DerivedA>& actual) {
+    using Scalar = typename DerivedP::Scalar;
+    const Scalar epsilon = std::is_same<Scalar, float>::value ? Scalar(1e-7) : Scalar(1e-12);
+    return - static_cast<double>((actual.array() * (predicted.array() + epsilon).log()).sum());
+}
+
+//标签为类别下标时 y 为 one-hot，损失只剩 -log(y_hat[label])
+template <typename DerivedP>
+double cross_entropy_loss(const Eigen::MatrixBase<DerivedP>& predicted, int label) {
+    using Scalar = typename DerivedP::Scalar;
+    const Scalar epsilon = std::is_same<Scalar, float>::value ? Scalar(1e-7) : Scalar(1e-12);
+    return - std::log(static_cast<double>(predicted(label) + epsilon));
+}
 
 //返回向量的最大值索引
-int argmax(const Eigen::VectorXd& vec);
+template <typename Derived>
+int argmax(const Eigen::MatrixBase<Derived>& vec) {
+    Eigen::Index maxIndex;
+    vec.maxCoeff(&maxIndex);
+    return static_cast<int>(maxIndex);
+}
 
 #endif
@@ -1,23 +1,50 @@
 #include "web_server.h"
 #include "neural_net.h"
+#include "base64.h"
+#include "logger.h"
+#include "metrics.h"
+#include "preprocess.h"
+#include "png_decode.h"
+#include "model_store.h"
 #include "crow_all.h"
+#include <algorithm>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <sstream>
-#include <iostream>
 #include <Eigen/Dense>
+#ifdef NR_USE_OPENCV
 #include <opencv2/opencv.hpp>
+#endif
 
-// base64 解码
-static std::string base64_decode(const std::string &in);
+// /metrics 输出的监控指标
+struct ServerMetrics {
+    // /predict 的结果：ok、decode_failure（JSON/base64/PNG 无法解析）、blank_image（空白或无效图像）、
+    // error（推理失败，调度器返回 label = -1）
+    Counter predict_ok, predict_decode_failure, predict_blank_image, predict_error;
+    // /predict_raw 的结果：ok、bad_request（长度不是整张图像）、too_large（图像数超过 max_raw_batch）
+    Counter raw_ok, raw_bad_request, raw_too_large;
+    // 模型热更新的结果
+    Counter reload_ok, reload_failure;
+    Gauge in_flight;
+    // 各阶段耗时（秒）
+    Histogram base64_seconds{Histogram::latency_buckets()};
+    Histogram imdecode_seconds{Histogram::latency_buckets()};
+    Histogram preprocess_seconds{Histogram::latency_buckets()};
+    Histogram forward_seconds{Histogram::latency_buckets()};
+    Histogram predict_seconds{Histogram::latency_buckets()};
+    Histogram predict_raw_seconds{Histogram::latency_buckets()};
+    // 每次前向传播合并的样本数
+    Histogram batch_size{Histogram::size_buckets()};
 
-// 将 base64 PNG 数据转为 28x28 Eigen::VectorXd
-static Eigen::VectorXd png_base64_to_vector(const std::string& base64_png);
+    std::string render(uint64_t model_generation) const;
+};
 
-void run_server() {
-    NeuralNetwork net(784, 128, 10);
-    
+// 将 base64 PNG 数据转为 28x28 的网络输入向量，并记录解码与预处理耗时
+static NeuralNetwork::Vector png_base64_to_vector(std::string_view base64_png, ServerMetrics& metrics);
+
+void run_server(const ServerOptions& options) {
+    const BatchOptions& batching = options.batching;
     // 尝试多个可能的模型路径
     std::string model_path;
     if (std::ifstream("../output/model_params.bin").good()) {
@@ -27,13 +54,33 @@ void run_server() {
     } else if (std::ifstream("./model_params.bin").good()) {
         model_path = "./model_params.bin";
     } else {
-        std::cerr << "找不到模型参数文件！请确保已训练模型。" << std::endl;
+        LOG_ERROR("找不到模型参数文件！请确保已训练模型。");
         return;
     }
     
-    std::cout << "加载模型参数: " << model_path << std::endl;
-    net.load_parameters(model_path);
+    LOG_INFO("加载模型参数: " << model_path);
+    std::unique_ptr<NeuralNetwork> net = NeuralNetwork::from_file(model_path);
+    if (!net) {
+        LOG_ERROR("模型参数加载失败: " << model_path);
+        return;
+    }
+    // 推理路径每批（/predict_raw 每个请求）取一次模型快照，热更新时正在处理的请求仍用旧模型完成
+    ModelStore models(std::move(net));
     crow::SimpleApp app;
+    ServerMetrics metrics;
+    ModelReloader reloader(models, model_path, std::chrono::milliseconds(std::max(0, options.model_poll_ms)),
+                           [&metrics](bool ok) { (ok ? metrics.reload_ok : metrics.reload_failure).inc(); });
+    if (options.model_poll_ms > 0)
+        LOG_INFO("监视模型参数文件，每 " << options.model_poll_ms << " ms 检查一次，变化后自动重新加载");
+    // 各工作线程只提交请求，由调度器的后台线程合并成批后统一推理
+    BatchOptions scheduler_options = batching;
+    scheduler_options.on_batch = [&metrics](int batch_size, double seconds) {
+        metrics.batch_size.observe(batch_size);
+        metrics.forward_seconds.observe(seconds);
+    };
+    BatchScheduler scheduler(models, scheduler_options);
+    LOG_INFO("微批处理: 每批最多 " << batching.max_batch << " 个请求，最长等待 "
+             << batching.max_delay_us << " us");
 
     CROW_ROUTE(app, "/")([](){
         return R"html(<!DOCTYPE html>
@@ -125,172 +172,199 @@ function predict() {
     });
 
     CROW_ROUTE(app, "/predict").methods("POST"_method)
-    ([&net](const crow::request& req){
+    ([&scheduler, &metrics](const crow::request& req){
+        ScopedIncrement in_flight(metrics.in_flight);
+        ScopedTimer timer(metrics.predict_seconds);
         auto body = crow::json::load(req.body);
-        if (!body) return crow::response(400);
-        std::string img_base64 = body["image"].s();
-        // 去掉 data:image/png;base64, 前缀
-        size_t pos = img_base64.find(",");
-        if (pos != std::string::npos) img_base64 = img_base64.substr(pos+1);
+        if (!body) {
+            metrics.predict_decode_failure.inc();
+            return crow::response(400);
+        }
+        // 直接引用 JSON 解析缓冲区中的字符串，去掉 data:image/png;base64, 前缀也不复制
+        auto image = body["image"].s();
+        std::string_view img_base64(image.begin(), image.size());
+        size_t pos = img_base64.find(',');
+        if (pos != std::string_view::npos) img_base64.remove_prefix(pos + 1);
         
-        Eigen::VectorXd input = png_base64_to_vector(img_base64);
+        NeuralNetwork::Vector input = png_base64_to_vector(img_base64, metrics);
         crow::json::wvalue res;
         
         // 检查特殊返回值
         if (input(0) == -1) {
+            metrics.predict_decode_failure.inc();
             res["error"] = "图像处理失败";
             return crow::response(400, res);
         } else if (input(0) == -2) {
+            metrics.predict_blank_image.inc();
             res["error"] = "请画一个清晰的数字再识别";
             return crow::response(400, res);
         }
         
-        int pred = net.predict(input);
-        std::cout << "神经网络预测结果: " << pred << std::endl;
-        res["result"] = pred;
+        BatchScheduler::Result prediction = scheduler.submit(std::move(input)).get();
+        if (prediction.label < 0) {
+            metrics.predict_error.inc();
+            res["error"] = "识别失败，请稍后重试";
+            return crow::response(500, res);
+        }
+        LOG_DEBUG("神经网络预测结果: " << prediction.label);
+        res["result"] = prediction.label;
+        std::vector<double> probs(prediction.probabilities.begin(), prediction.probabilities.end());
+        res["probabilities"] = probs;
+        metrics.predict_ok.inc();
+        return crow::response{res};
+    });
+
+    // 已预处理好的原始像素：请求体为 N x 784 字节（MNIST 格式，白字黑底，每像素 0~255），
+    // 跳过 JSON、base64 与 PNG 解码，整批直接推理。返回 {"results": [N 个预测数字]}；
+    // N 超过 max_raw_batch 时返回 413，不做推理
+    const size_t max_raw_batch = static_cast<size_t>(std::max(1, options.max_raw_batch));
+    CROW_ROUTE(app, "/predict_raw").methods("POST"_method)
+    ([&models, &metrics, max_raw_batch](const crow::request& req){
+        ScopedIncrement in_flight(metrics.in_flight);
+        ScopedTimer timer(metrics.predict_raw_seconds);
+        ModelStore::Snapshot model = models.current();
+        const size_t image_bytes = static_cast<size_t>(model->num_inputs());
+        crow::json::wvalue res;
+        if (req.body.empty() || req.body.size() % image_bytes != 0) {
+            metrics.raw_bad_request.inc();
+            res["error"] = "请求体长度必须是 " + std::to_string(image_bytes) + " 字节的整数倍";
+            return crow::response(400, res);
+        }
+        size_t count = req.body.size() / image_bytes;
+        if (count > max_raw_batch) {
+            metrics.raw_too_large.inc();
+            res["error"] = "每个请求最多 " + std::to_string(max_raw_batch) + " 张图像";
+            return crow::response(413, res);
+        }
+        std::vector<int> preds;
+        {
+            ScopedTimer forward_timer(metrics.forward_seconds);
+            preds = model->predict_batch(reinterpret_cast<const uint8_t*>(req.body.data()), count);
+        }
+        metrics.batch_size.observe(static_cast<double>(count));
+        metrics.raw_ok.inc();
+        res["results"] = preds;
         return crow::response{res};
     });
 
-    std::cout << "请在浏览器打开 http://127.0.0.1:18080/ 进行手写数字识别体验" << std::endl;
+    // 管理接口：立即重新加载模型参数文件（只接受本机请求），例如
+    // curl -X POST http://127.0.0.1:18080/admin/reload
+    CROW_ROUTE(app, "/admin/reload").methods("POST"_method)
+    ([&reloader, &models](const crow::request& req){
+        crow::json::wvalue res;
+        if (req.remote_ip_address != "127.0.0.1" && req.remote_ip_address != "::1") {
+            LOG_WARN("拒绝来自 " << req.remote_ip_address << " 的模型重载请求");
+            res["error"] = "只允许本机访问";
+            return crow::response(403, res);
+        }
+        bool ok = reloader.reload();
+        res["reloaded"] = ok;
+        res["generation"] = models.generation();
+        return crow::response(ok ? 200 : 500, res);
+    });
+
+    // Prometheus 文本格式的监控指标
+    CROW_ROUTE(app, "/metrics")([&metrics, &models](){
+        crow::response res(metrics.render(models.generation()));
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
+
+    LOG_INFO("请在浏览器打开 http://127.0.0.1:18080/ 进行手写数字识别体验");
     app.port(18080).multithreaded().run();
 }
 
-// 简化的 base64 解码实现
-#include <openssl/bio.h>
-#include <openssl/evp.h>
-#include <openssl/buffer.h>
-static std::string base64_decode(const std::string &input) {
-    BIO *bio, *b64;
-    int decodeLen = input.length() * 3 / 4;
-    std::string result(decodeLen, '\0');
-    
-    bio = BIO_new_mem_buf(input.data(), -1);
-    b64 = BIO_new(BIO_f_base64());
-    bio = BIO_push(b64, bio);
-    
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-    int len = BIO_read(bio, &result[0], input.length());
-    BIO_free_all(bio);
-    
-    if (len > 0) {
-        result.resize(len);
-    } else {
-        result.clear();
-    }
-    return result;
+std::string ServerMetrics::render(uint64_t model_generation) const {
+    std::string out;
+    write_metric_header(out, "nr_requests_total", "counter", "Requests by endpoint and outcome");
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict\",outcome=\"ok\"", predict_ok.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict\",outcome=\"decode_failure\"",
+                        predict_decode_failure.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict\",outcome=\"blank_image\"",
+                        predict_blank_image.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict\",outcome=\"error\"", predict_error.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict_raw\",outcome=\"ok\"", raw_ok.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict_raw\",outcome=\"bad_request\"",
+                        raw_bad_request.get());
+    write_metric_sample(out, "nr_requests_total", "endpoint=\"predict_raw\",outcome=\"too_large\"",
+                        raw_too_large.get());
+    write_metric_header(out, "nr_requests_in_flight", "gauge", "Requests currently being handled");
+    write_metric_sample(out, "nr_requests_in_flight", "", in_flight.get());
+    write_metric_header(out, "nr_stage_seconds", "histogram", "Time spent in each processing stage");
+    base64_seconds.write(out, "nr_stage_seconds", "stage=\"base64\"");
+    imdecode_seconds.write(out, "nr_stage_seconds", "stage=\"imdecode\"");
+    preprocess_seconds.write(out, "nr_stage_seconds", "stage=\"preprocess\"");
+    forward_seconds.write(out, "nr_stage_seconds", "stage=\"forward\"");
+    write_metric_header(out, "nr_request_seconds", "histogram", "End-to-end handler latency");
+    predict_seconds.write(out, "nr_request_seconds", "endpoint=\"predict\"");
+    predict_raw_seconds.write(out, "nr_request_seconds", "endpoint=\"predict_raw\"");
+    write_metric_header(out, "nr_batch_size", "histogram", "Samples per forward pass");
+    batch_size.write(out, "nr_batch_size", "");
+    write_metric_header(out, "nr_model_reloads_total", "counter", "Model reload attempts by outcome");
+    write_metric_sample(out, "nr_model_reloads_total", "outcome=\"ok\"", reload_ok.get());
+    write_metric_sample(out, "nr_model_reloads_total", "outcome=\"failure\"", reload_failure.get());
+    write_metric_header(out, "nr_model_generation", "gauge", "Sequence number of the model currently served");
+    write_metric_sample(out, "nr_model_generation", "", static_cast<double>(model_generation));
+    write_metric_header(out, "nr_log_dropped_total", "counter", "Log messages dropped because the ring was full");
+    write_metric_sample(out, "nr_log_dropped_total", "", static_cast<double>(log_dropped_count()));
+    return out;
 }
 
-// base64 PNG -> 28x28 Eigen::VectorXd
-static Eigen::VectorXd png_base64_to_vector(const std::string& base64_png) {
+// base64 PNG -> 28x28 网络输入向量
+static NeuralNetwork::Vector png_base64_to_vector(std::string_view base64_png, ServerMetrics& metrics) {
     try {
-        std::string png_data = base64_decode(base64_png);
-        if (png_data.empty()) {
-            std::cerr << "Base64 解码失败" << std::endl;
-            return Eigen::VectorXd::Constant(784, -1); // 用-1表示错误
+        std::vector<uint8_t> buf;
+        bool decoded;
+        {
+            ScopedTimer timer(metrics.base64_seconds);
+            decoded = base64_decode(base64_png, buf);
         }
-        
-        std::vector<uchar> buf(png_data.begin(), png_data.end());
-        cv::Mat img = cv::imdecode(buf, cv::IMREAD_GRAYSCALE);
-        
-        if (img.empty()) {
-            std::cerr << "PNG 解码失败" << std::endl;
-            return Eigen::VectorXd::Constant(784, -1);
+        if (!decoded || buf.empty()) {
+            LOG_WARN("Base64 解码失败");
+            return NeuralNetwork::Vector::Constant(784, -1); // 用-1表示错误
         }
         
-        std::cout << "原始图像尺寸: " << img.rows << "x" << img.cols << std::endl;
-        
-        // 检查是否为空白图像（几乎全白或全黑）
-        cv::Scalar mean_val_orig = cv::mean(img);
-        std::cout << "原始图像均值: " << mean_val_orig[0] << std::endl;
-        
-        // 如果图像几乎全白（背景）或全黑，认为是空白图像
-        if (mean_val_orig[0] > 250 || mean_val_orig[0] < 5) {
-            std::cout << "检测到空白图像，拒绝识别" << std::endl;
-            return Eigen::VectorXd::Constant(784, -2); // 用-2表示空白图像
+        // 构建时关闭 NR_WITH_OPENCV 则使用自带的 PNG 解码器，两者得到相同的灰度图
+#ifdef NR_USE_OPENCV
+        cv::Mat img;
+        {
+            ScopedTimer timer(metrics.imdecode_seconds);
+            img = cv::imdecode(buf, cv::IMREAD_GRAYSCALE);
         }
-        
-        // 寻找内容边界框，裁剪掉多余的空白部分
-        cv::Mat binary;
-        cv::threshold(img, binary, 128, 255, cv::THRESH_BINARY_INV);
-        
-        std::vector<std::vector<cv::Point>> contours;
-        cv::findContours(binary, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-        
-        if (contours.empty()) {
-            std::cout << "未找到有效内容，拒绝识别" << std::endl;
-            return Eigen::VectorXd::Constant(784, -2);
+        GrayImage image{img.data, img.rows, img.cols, img.step};
+#else
+        PngImage img;
+        {
+            ScopedTimer timer(metrics.imdecode_seconds);
+            decode_png_gray(buf.data(), buf.size(), img);
         }
+        GrayImage image = img.view();
+#endif
         
-        // 找到最大的轮廓（假设是数字）
-        cv::Rect boundingBox = cv::boundingRect(contours[0]);
-        for (size_t i = 1; i < contours.size(); ++i) {
-            cv::Rect rect = cv::boundingRect(contours[i]);
-            if (rect.area() > boundingBox.area()) {
-                boundingBox = rect;
-            }
+        if (image.rows == 0) {
+            LOG_WARN("PNG 解码失败");
+            return NeuralNetwork::Vector::Constant(784, -1);
         }
+        ScopedTimer preprocess_timer(metrics.preprocess_seconds);
         
-        std::cout << "内容边界框: " << boundingBox.x << "," << boundingBox.y 
-                  << " " << boundingBox.width << "x" << boundingBox.height << std::endl;
+        // 裁剪、缩放到 28x28、反色与归一化一次完成，直接写入网络输入向量
+        NeuralNetwork::Vector v(kDigitPixels);
+        PreprocessStats stats;
+        PreprocessStatus status = preprocess_digit(image, v.data(), &stats);
         
-        // 添加一些边距
-        int margin = 10;
-        boundingBox.x = std::max(0, boundingBox.x - margin);
-        boundingBox.y = std::max(0, boundingBox.y - margin);
-        boundingBox.width = std::min(img.cols - boundingBox.x, boundingBox.width + 2*margin);
-        boundingBox.height = std::min(img.rows - boundingBox.y, boundingBox.height + 2*margin);
-        
-        // 裁剪到内容区域
-        cv::Mat cropped = img(boundingBox);
-        
-        // 创建正方形图像，保持宽高比
-        int maxDim = std::max(cropped.rows, cropped.cols);
-        cv::Mat square = cv::Mat::ones(maxDim, maxDim, CV_8UC1) * 255; // 白色背景
-        
-        int offsetX = (maxDim - cropped.cols) / 2;
-        int offsetY = (maxDim - cropped.rows) / 2;
-        cropped.copyTo(square(cv::Rect(offsetX, offsetY, cropped.cols, cropped.rows)));
-        
-        // 调整到 28x28
-        cv::resize(square, img, cv::Size(28, 28), 0, 0, cv::INTER_AREA);
-        
-        // 反转颜色：Canvas是黑字白底，MNIST是白字黑底
-        cv::bitwise_not(img, img);
-        
-        // 转换为 double 类型，归一化到 [0,1]
-        img.convertTo(img, CV_64F, 1.0/255.0);
-        
-        // 计算最终图像统计信息
-        cv::Scalar mean_val = cv::mean(img);
-        double min_val, max_val;
-        cv::minMaxLoc(img, &min_val, &max_val);
-        std::cout << "最终图像统计 - 均值: " << mean_val[0] << ", 最小值: " << min_val << ", 最大值: " << max_val << std::endl;
-        
-        // 转为 Eigen::VectorXd
-        Eigen::VectorXd v(784);
-        for (int i = 0; i < 28; ++i) {
-            for (int j = 0; j < 28; ++j) {
-                v(i * 28 + j) = img.at<double>(i, j);
-            }
-        }
-        
-        // 检查是否有有效的像素变化
-        double variance = 0;
-        double mean = mean_val[0];
-        for (int i = 0; i < 784; ++i) {
-            variance += (v(i) - mean) * (v(i) - mean);
-        }
-        variance /= 784;
-        std::cout << "像素方差: " << variance << std::endl;
+        // 每个请求的统计信息合并为一条 Debug 日志，按采样率记录
+        LOG_DEBUG("图像统计 原始尺寸=" << image.rows << "x" << image.cols << " 原始均值=" << stats.source_mean
+                  << " 边界框=" << stats.box_x << "," << stats.box_y << "," << stats.box_width << "x" << stats.box_height
+                  << " 均值=" << stats.mean << " 最小值=" << stats.min << " 最大值=" << stats.max << " 方差=" << stats.variance);
         
-        if (variance < 0.01) {
-            std::cout << "图像变化太小，可能是无效输入" << std::endl;
-            return Eigen::VectorXd::Constant(784, -2);
+        if (status != PreprocessStatus::Ok) {
+            LOG_INFO("空白或无效图像，拒绝识别 原始均值=" << stats.source_mean << " 方差=" << stats.variance);
+            return NeuralNetwork::Vector::Constant(784, -2); // 用-2表示空白图像
         }
         
         return v;
     } catch (const std::exception& e) {
-        std::cerr << "图像处理异常: " << e.what() << std::endl;
-        return Eigen::VectorXd::Constant(784, -1);
+        LOG_ERROR("图像处理异常: " << e.what());
+        return NeuralNetwork::Vector::Constant(784, -1);
     }
 } 
\ No newline at end of file
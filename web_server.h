@@ -1,2 +1,15 @@
 #pragma once
-void run_server(); 
\ No newline at end of file
+#include "batch_scheduler.h"
+
+// Web 服务参数
+struct ServerOptions {
+    BatchOptions batching;
+    // 每隔多少毫秒检查一次模型参数文件，文件变化后在后台加载并替换模型；0 表示不监视
+    // （仍可 POST /admin/reload 手动重载）
+    int model_poll_ms = 1000;
+    // /predict_raw 每个请求最多的图像数，超过时返回 413，限制单个请求占用的内存与推理时间
+    int max_raw_batch = 4096;
+};
+
+// 启动 Web 服务；并发的 /predict 请求经 BatchScheduler 合并成批后推理
+void run_server(const ServerOptions& options = ServerOptions());